@@ -0,0 +1,352 @@
+//
+//  shmRing.cpp
+//  MNN
+//
+//  Shared memory ring buffers for co-located frame producers
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <new>
+#include "MNN/MNNDefine.h"
+#include "shmRing.h"
+
+
+static size_t align_up(size_t size)
+{
+    return (size + SHM_RING_ALIGN - 1) / SHM_RING_ALIGN * SHM_RING_ALIGN;
+}
+
+static size_t frame_ring_header_size()
+{
+    return align_up(sizeof(t_frame_ring_header));
+}
+
+static size_t result_ring_header_size()
+{
+    return align_up(sizeof(t_result_ring_header));
+}
+
+static size_t result_slot_size(uint32_t max_objects)
+{
+    return align_up(sizeof(t_result_slot_header) + max_objects * sizeof(t_result_record));
+}
+
+
+static bool shm_ring_map(t_shm_ring& ring, const std::string& name, size_t size, bool create)
+{
+    ring.name = name;
+    ring.fd = -1;
+    ring.size = 0;
+    ring.base = nullptr;
+
+    if (create) {
+        // always start from a clean ring
+        shm_unlink(name.c_str());
+        ring.fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    } else {
+        ring.fd = shm_open(name.c_str(), O_RDWR, 0);
+    }
+    if (ring.fd < 0) {
+        MNN_ERROR("Can't open shared memory %s: %s\n", name.c_str(), strerror(errno));
+        return false;
+    }
+
+    if (create) {
+        if (ftruncate(ring.fd, size) < 0) {
+            MNN_ERROR("Can't resize shared memory %s: %s\n", name.c_str(), strerror(errno));
+            shm_ring_close(ring, true);
+            return false;
+        }
+    } else {
+        // size of opened ring comes from the creator
+        struct stat st;
+        if (fstat(ring.fd, &st) < 0 || size_t(st.st_size) < size) {
+            MNN_ERROR("Invalid shared memory %s\n", name.c_str());
+            shm_ring_close(ring, false);
+            return false;
+        }
+        size = st.st_size;
+    }
+
+    void* base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, ring.fd, 0);
+    if (base == MAP_FAILED) {
+        MNN_ERROR("Can't map shared memory %s: %s\n", name.c_str(), strerror(errno));
+        shm_ring_close(ring, create);
+        return false;
+    }
+    ring.base = (uint8_t*)base;
+    ring.size = size;
+    return true;
+}
+
+
+void shm_ring_close(t_shm_ring& ring, bool unlink_name)
+{
+    if (ring.base != nullptr) {
+        munmap(ring.base, ring.size);
+        ring.base = nullptr;
+    }
+    if (ring.fd >= 0) {
+        close(ring.fd);
+        ring.fd = -1;
+    }
+    if (unlink_name) {
+        shm_unlink(ring.name.c_str());
+    }
+    return;
+}
+
+
+static t_frame_slot_header* frame_ring_slot(t_shm_ring& ring, uint64_t pos)
+{
+    auto header = reinterpret_cast<t_frame_ring_header*>(ring.base);
+    return reinterpret_cast<t_frame_slot_header*>(ring.base + frame_ring_header_size() +
+                                                  (pos % header->slot_num) * header->slot_size);
+}
+
+
+bool frame_ring_create(t_shm_ring& ring, const std::string& name, uint32_t slot_num, uint32_t max_frame_size)
+{
+    uint32_t slot_size = align_up(sizeof(t_frame_slot_header) + max_frame_size);
+    if (!shm_ring_map(ring, name, frame_ring_header_size() + size_t(slot_num) * slot_size, true)) {
+        return false;
+    }
+
+    auto header = new (ring.base) t_frame_ring_header;
+    header->magic.store(0, std::memory_order_relaxed);
+    header->version = SHM_RING_VERSION;
+    header->slot_num = slot_num;
+    header->slot_size = slot_size;
+    header->enqueue_pos.store(0, std::memory_order_relaxed);
+    header->dequeue_pos.store(0, std::memory_order_relaxed);
+
+    for (uint32_t i = 0; i < slot_num; i++) {
+        auto slot = new (frame_ring_slot(ring, i)) t_frame_slot_header;
+        slot->sequence.store(i, std::memory_order_relaxed);
+    }
+
+    // magic is the last one to be set, as the ready flag for producers
+    header->magic.store(SHM_FRAME_RING_MAGIC, std::memory_order_release);
+    return true;
+}
+
+
+bool frame_ring_open(t_shm_ring& ring, const std::string& name)
+{
+    if (!shm_ring_map(ring, name, frame_ring_header_size(), false)) {
+        return false;
+    }
+
+    // header fields are only read after the ready flag
+    auto header = reinterpret_cast<t_frame_ring_header*>(ring.base);
+    if (header->magic.load(std::memory_order_acquire) != SHM_FRAME_RING_MAGIC || header->version != SHM_RING_VERSION ||
+        ring.size < frame_ring_header_size() + size_t(header->slot_num) * header->slot_size) {
+        MNN_ERROR("Frame ring %s is not ready\n", name.c_str());
+        shm_ring_close(ring, false);
+        return false;
+    }
+    return true;
+}
+
+
+t_frame_slot_header* frame_ring_reserve(t_shm_ring& ring, uint64_t& pos)
+{
+    auto header = reinterpret_cast<t_frame_ring_header*>(ring.base);
+
+    // claim enqueue position by CAS, so multiple producers could
+    // fill different slots concurrently
+    pos = header->enqueue_pos.load(std::memory_order_relaxed);
+    while (true) {
+        auto slot = frame_ring_slot(ring, pos);
+        uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+        int64_t diff = int64_t(sequence) - int64_t(pos);
+
+        if (diff == 0) {
+            if (header->enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                return slot;
+            }
+        } else if (diff < 0) {
+            // slot is still held by detector, ring is full
+            return nullptr;
+        } else {
+            pos = header->enqueue_pos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+
+void frame_ring_commit(t_shm_ring& ring, t_frame_slot_header* slot, uint64_t pos)
+{
+    slot->sequence.store(pos + 1, std::memory_order_release);
+    return;
+}
+
+
+t_frame_slot_header* frame_ring_front(t_shm_ring& ring, uint32_t offset)
+{
+    auto header = reinterpret_cast<t_frame_ring_header*>(ring.base);
+    if (offset >= header->slot_num) {
+        return nullptr;
+    }
+
+    // single consumer, no need to CAS dequeue position
+    uint64_t pos = header->dequeue_pos.load(std::memory_order_relaxed) + offset;
+    auto slot = frame_ring_slot(ring, pos);
+    if (slot->sequence.load(std::memory_order_acquire) != pos + 1) {
+        return nullptr;
+    }
+    return slot;
+}
+
+
+void frame_ring_pop(t_shm_ring& ring)
+{
+    auto header = reinterpret_cast<t_frame_ring_header*>(ring.base);
+
+    uint64_t pos = header->dequeue_pos.load(std::memory_order_relaxed);
+    auto slot = frame_ring_slot(ring, pos);
+    header->dequeue_pos.store(pos + 1, std::memory_order_relaxed);
+    // hand the slot back to producers for next round
+    slot->sequence.store(pos + header->slot_num, std::memory_order_release);
+    return;
+}
+
+
+static t_result_slot_header* result_ring_slot(t_shm_ring& ring, uint64_t pos)
+{
+    auto header = reinterpret_cast<t_result_ring_header*>(ring.base);
+    return reinterpret_cast<t_result_slot_header*>(ring.base + result_ring_header_size() +
+                                                   (pos % header->slot_num) * result_slot_size(header->max_objects));
+}
+
+
+bool result_ring_create(t_shm_ring& ring, const std::string& name, uint32_t slot_num, uint32_t max_objects)
+{
+    if (!shm_ring_map(ring, name, result_ring_header_size() + size_t(slot_num) * result_slot_size(max_objects), true)) {
+        return false;
+    }
+
+    auto header = new (ring.base) t_result_ring_header;
+    header->magic.store(0, std::memory_order_relaxed);
+    header->version = SHM_RING_VERSION;
+    header->slot_num = slot_num;
+    header->max_objects = max_objects;
+    header->publish_pos.store(0, std::memory_order_relaxed);
+
+    for (uint32_t i = 0; i < slot_num; i++) {
+        auto slot = new (result_ring_slot(ring, i)) t_result_slot_header;
+        slot->sequence.store(0, std::memory_order_relaxed);
+        slot->position = UINT64_MAX;
+    }
+
+    header->magic.store(SHM_RESULT_RING_MAGIC, std::memory_order_release);
+    return true;
+}
+
+
+bool result_ring_open(t_shm_ring& ring, const std::string& name)
+{
+    if (!shm_ring_map(ring, name, result_ring_header_size(), false)) {
+        return false;
+    }
+
+    auto header = reinterpret_cast<t_result_ring_header*>(ring.base);
+    if (header->magic.load(std::memory_order_acquire) != SHM_RESULT_RING_MAGIC || header->version != SHM_RING_VERSION ||
+        ring.size < result_ring_header_size() + size_t(header->slot_num) * result_slot_size(header->max_objects)) {
+        MNN_ERROR("Result ring %s is not ready\n", name.c_str());
+        shm_ring_close(ring, false);
+        return false;
+    }
+    return true;
+}
+
+
+void result_ring_publish(t_shm_ring& ring, const t_frame_slot_header* frame,
+                         const std::vector<t_prediction>& prediction_nms_list)
+{
+    auto header = reinterpret_cast<t_result_ring_header*>(ring.base);
+
+    // only detector publishes, so position needs no CAS
+    uint64_t pos = header->publish_pos.load(std::memory_order_relaxed);
+    auto slot = result_ring_slot(ring, pos);
+    auto records = reinterpret_cast<t_result_record*>(reinterpret_cast<uint8_t*>(slot) + sizeof(t_result_slot_header));
+
+    // seqlock write: odd sequence marks the slot as being updated
+    uint64_t sequence = slot->sequence.load(std::memory_order_relaxed);
+    slot->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    uint32_t num_objects = std::min(prediction_nms_list.size(), size_t(header->max_objects));
+    slot->position = pos;
+    slot->frame_id = frame->frame_id;
+    slot->source_id = frame->source_id;
+    slot->num_objects = num_objects;
+
+    slot->image_record.image_index = uint32_t(frame->frame_id);
+    slot->image_record.class_index = -1;
+    slot->image_record.confidence = num_objects;
+    slot->image_record.x = 0;
+    slot->image_record.y = 0;
+    slot->image_record.width = frame->width;
+    slot->image_record.height = frame->height;
+    slot->image_record.track_id = -1;
+
+    for (uint32_t i = 0; i < num_objects; i++) {
+        auto& prediction_nms = prediction_nms_list[i];
+        records[i].image_index = uint32_t(frame->frame_id);
+        records[i].class_index = prediction_nms.class_index;
+        records[i].confidence = prediction_nms.confidence;
+        records[i].x = prediction_nms.x;
+        records[i].y = prediction_nms.y;
+        records[i].width = prediction_nms.width;
+        records[i].height = prediction_nms.height;
+        records[i].track_id = prediction_nms.track_id;
+    }
+
+    slot->sequence.store(sequence + 2, std::memory_order_release);
+    header->publish_pos.store(pos + 1, std::memory_order_release);
+    return;
+}
+
+
+bool result_ring_read(t_shm_ring& ring, uint64_t pos, t_result_slot_header& result,
+                      std::vector<t_result_record>& records)
+{
+    auto header = reinterpret_cast<t_result_ring_header*>(ring.base);
+    if (pos >= header->publish_pos.load(std::memory_order_acquire)) {
+        return false;
+    }
+
+    auto slot = result_ring_slot(ring, pos);
+    auto slot_records = reinterpret_cast<t_result_record*>(reinterpret_cast<uint8_t*>(slot) + sizeof(t_result_slot_header));
+
+    // seqlock read: retry if detector updated the slot meanwhile
+    while (true) {
+        uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+        if (sequence & 1) {
+            continue;
+        }
+
+        result.position = slot->position;
+        result.frame_id = slot->frame_id;
+        result.source_id = slot->source_id;
+        result.num_objects = std::min(slot->num_objects, header->max_objects);
+        result.image_record = slot->image_record;
+        records.assign(slot_records, slot_records + result.num_objects);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot->sequence.load(std::memory_order_relaxed) == sequence) {
+            break;
+        }
+    }
+
+    // slot has been overwritten by a newer result
+    return result.position == pos;
+}
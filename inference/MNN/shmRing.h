@@ -0,0 +1,126 @@
+//
+//  shmRing.h
+//  MNN
+//
+//  Shared memory ring buffers for co-located frame producers:
+//
+//  * frame ring ("<name>_frames"): producers write RGB888 frames
+//    into slots and detector decodes them in place. It's a bounded
+//    MPSC queue with per-slot sequence numbers, so any number of
+//    producers could push without lock
+//
+//  * result ring ("<name>_results"): detector publishes detection
+//    results of every frame. Slots are overwritten in circle and
+//    guarded by a per-slot seqlock, so readers never block detector
+//
+
+#ifndef YOLO_DETECTION_SHM_RING_H_
+#define YOLO_DETECTION_SHM_RING_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <string>
+#include <vector>
+#include "resultWriter.h"
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "shared memory ring needs lock free 64-bit atomic");
+static_assert(ATOMIC_INT_LOCK_FREE == 2, "shared memory ring needs lock free 32-bit atomic");
+
+#define SHM_RING_VERSION 2
+#define SHM_RING_ALIGN 64
+
+// ring magic, "YFRM"/"YRES" in memory on little endian host. it's
+// stored last with release by the creator as the ready flag, so
+// header fields are valid once it's loaded with acquire
+#define SHM_RING_MAGIC(a, b, c, d) (uint32_t(a) | (uint32_t(b) << 8) | (uint32_t(c) << 16) | (uint32_t(d) << 24))
+#define SHM_FRAME_RING_MAGIC SHM_RING_MAGIC('Y', 'F', 'R', 'M')
+#define SHM_RESULT_RING_MAGIC SHM_RING_MAGIC('Y', 'R', 'E', 'S')
+
+// default ring geometry when detector creates the rings
+#define SHM_FRAME_SLOT_NUM 8
+#define SHM_FRAME_MAX_SIZE (1920 * 1080 * 3)
+#define SHM_RESULT_SLOT_NUM 64
+#define SHM_RESULT_MAX_OBJECTS 100
+
+
+typedef struct frame_ring_header {
+    std::atomic<uint32_t> magic;        // SHM_FRAME_RING_MAGIC, 0 until ready
+    uint32_t version;
+    uint32_t slot_num;
+    uint32_t slot_size;                 // bytes of a slot, including t_frame_slot_header
+    alignas(SHM_RING_ALIGN) std::atomic<uint64_t> enqueue_pos;
+    alignas(SHM_RING_ALIGN) std::atomic<uint64_t> dequeue_pos;
+}t_frame_ring_header;
+
+// frame slot header, followed by width * height * 3 RGB888 data
+typedef struct frame_slot_header {
+    std::atomic<uint64_t> sequence;     // == pos: free, == pos + 1: frame ready
+    uint64_t frame_id;                  // filled by producer, echoed in result
+    uint32_t source_id;                 // filled by producer, echoed in result
+    uint32_t width;
+    uint32_t height;
+    uint32_t reserved;
+}t_frame_slot_header;
+
+
+typedef struct result_ring_header {
+    std::atomic<uint32_t> magic;        // SHM_RESULT_RING_MAGIC, 0 until ready
+    uint32_t version;
+    uint32_t slot_num;
+    uint32_t max_objects;
+    alignas(SHM_RING_ALIGN) std::atomic<uint64_t> publish_pos;  // count of published results
+}t_result_ring_header;
+
+// result slot header, followed by max_objects t_result_record
+typedef struct result_slot_header {
+    std::atomic<uint64_t> sequence;     // seqlock, odd while detector is writing
+    uint64_t position;                  // publish position of this result
+    uint64_t frame_id;
+    uint32_t source_id;
+    uint32_t num_objects;               // object record number, capped by max_objects
+    t_result_record image_record;       // class_index -1, image width/height
+}t_result_slot_header;
+
+
+typedef struct shm_ring {
+    std::string name;
+    int fd;
+    size_t size;
+    uint8_t* base;
+}t_shm_ring;
+
+
+// create (detector side) or open (producer/reader side) the rings
+bool frame_ring_create(t_shm_ring& ring, const std::string& name, uint32_t slot_num, uint32_t max_frame_size);
+bool frame_ring_open(t_shm_ring& ring, const std::string& name);
+bool result_ring_create(t_shm_ring& ring, const std::string& name, uint32_t slot_num, uint32_t max_objects);
+bool result_ring_open(t_shm_ring& ring, const std::string& name);
+void shm_ring_close(t_shm_ring& ring, bool unlink_name);
+
+// producer: get a free slot to fill frame in place, then commit it.
+// return nullptr if the ring is full
+t_frame_slot_header* frame_ring_reserve(t_shm_ring& ring, uint64_t& pos);
+void frame_ring_commit(t_shm_ring& ring, t_frame_slot_header* slot, uint64_t pos);
+
+// detector: get the ready frame at offset from the oldest one, to
+// read in place. return nullptr if it's not ready. frame_ring_pop()
+// releases the oldest frame back to producers after use
+t_frame_slot_header* frame_ring_front(t_shm_ring& ring, uint32_t offset = 0);
+void frame_ring_pop(t_shm_ring& ring);
+
+inline uint8_t* frame_slot_data(t_frame_slot_header* slot)
+{
+    return reinterpret_cast<uint8_t*>(slot) + sizeof(t_frame_slot_header);
+}
+
+// detector: publish detection result of a frame
+void result_ring_publish(t_shm_ring& ring, const t_frame_slot_header* frame,
+                         const std::vector<t_prediction>& prediction_nms_list);
+
+// reader: copy out the result at publish position pos. return false if
+// it's not published yet or already overwritten
+bool result_ring_read(t_shm_ring& ring, uint64_t pos, t_result_slot_header& result,
+                      std::vector<t_result_record>& records);
+
+#endif  // YOLO_DETECTION_SHM_RING_H_
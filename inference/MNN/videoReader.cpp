@@ -0,0 +1,277 @@
+//
+//  videoReader.cpp
+//  MNN
+//
+//  Memory mapped reader of uncompressed video file (Y4M, raw
+//  YUV/RGB), for offline stream benchmark
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <sstream>
+
+#include "videoReader.h"
+
+
+VideoReader::VideoReader()
+    : mFd(-1), mBase(nullptr), mSize(0), mWidth(0), mHeight(0), mFps(30), mFormat(PIXEL_YUV_PLANAR),
+      mHasChroma(true), mChromaShiftX(1), mChromaShiftY(1)
+{
+}
+
+
+VideoReader::~VideoReader()
+{
+    close();
+}
+
+
+void VideoReader::close()
+{
+    if (mBase != nullptr) {
+        munmap(mBase, mSize);
+        mBase = nullptr;
+    }
+    if (mFd >= 0) {
+        ::close(mFd);
+        mFd = -1;
+    }
+    mSize = 0;
+    mFrameOffsets.clear();
+    return;
+}
+
+
+size_t VideoReader::get_frame_size() const
+{
+    size_t luma_size = size_t(mWidth) * mHeight;
+    if (mFormat == PIXEL_RGB24) {
+        return luma_size * 3;
+    }
+    if (!mHasChroma) {
+        return luma_size;
+    }
+    size_t chroma_size = size_t((mWidth + (1 << mChromaShiftX) - 1) >> mChromaShiftX) *
+                         ((mHeight + (1 << mChromaShiftY) - 1) >> mChromaShiftY);
+    return luma_size + 2 * chroma_size;
+}
+
+
+// Y4M header like "YUV4MPEG2 W1920 H1080 F30000:1001 Ip A1:1 C420jpeg"
+bool VideoReader::parse_y4m_header(const std::string& header)
+{
+    std::stringstream ss(header);
+    std::string token;
+    std::string color_space = "420";
+
+    ss >> token;
+    while (ss >> token) {
+        switch (token[0]) {
+            case 'W':
+                mWidth = atoi(token.c_str() + 1);
+                break;
+            case 'H':
+                mHeight = atoi(token.c_str() + 1);
+                break;
+            case 'F': {
+                int num = 0, den = 0;
+                if (sscanf(token.c_str() + 1, "%d:%d", &num, &den) == 2 && num > 0 && den > 0) {
+                    mFps = double(num) / den;
+                }
+                break;
+            }
+            case 'C':
+                color_space = token.substr(1);
+                break;
+            default:
+                // interlace, aspect ratio & extensions are ignored
+                break;
+        }
+    }
+
+    // only 8-bit color spaces are supported
+    mFormat = PIXEL_YUV_PLANAR;
+    mHasChroma = true;
+    if (color_space == "420" || color_space == "420jpeg" || color_space == "420paldv" || color_space == "420mpeg2") {
+        mChromaShiftX = 1;
+        mChromaShiftY = 1;
+    } else if (color_space == "422") {
+        mChromaShiftX = 1;
+        mChromaShiftY = 0;
+    } else if (color_space == "444") {
+        mChromaShiftX = 0;
+        mChromaShiftY = 0;
+    } else if (color_space == "mono") {
+        mHasChroma = false;
+    } else {
+        MNN_ERROR("Unsupported Y4M color space %s\n", color_space.c_str());
+        return false;
+    }
+    return mWidth > 0 && mHeight > 0;
+}
+
+
+// raw format like "i420:1920x1080"
+bool VideoReader::parse_raw_format(const std::string& raw_format)
+{
+    size_t pos = raw_format.find(':');
+    if (pos == std::string::npos) {
+        return false;
+    }
+
+    // frame size is any "WxH", unlike model input size (multiple of 32)
+    char tail = 0;
+    if (sscanf(raw_format.c_str() + pos + 1, "%dx%d%c", &mWidth, &mHeight, &tail) != 2 || mWidth <= 0 || mHeight <= 0) {
+        return false;
+    }
+
+    std::string format = raw_format.substr(0, pos);
+    mHasChroma = true;
+    mChromaShiftX = 1;
+    mChromaShiftY = 1;
+    if (format == "i420" || format == "yuv420p") {
+        mFormat = PIXEL_YUV_PLANAR;
+    } else if (format == "nv12") {
+        mFormat = PIXEL_NV12;
+    } else if (format == "rgb24") {
+        mFormat = PIXEL_RGB24;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+
+bool VideoReader::open(const std::string& file_name, const std::string& raw_format)
+{
+    close();
+
+    mFd = ::open(file_name.c_str(), O_RDONLY);
+    struct stat st;
+    if (mFd < 0 || fstat(mFd, &st) < 0 || st.st_size == 0) {
+        MNN_ERROR("Can't open video %s: %s\n", file_name.c_str(), strerror(errno));
+        close();
+        return false;
+    }
+
+    // frames are read in place from the mapping, and kernel is hinted
+    // to read ahead for sequential access
+    void* base = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, mFd, 0);
+    if (base == MAP_FAILED) {
+        MNN_ERROR("Can't map video %s: %s\n", file_name.c_str(), strerror(errno));
+        close();
+        return false;
+    }
+    mBase = (uint8_t*)base;
+    mSize = st.st_size;
+    madvise(mBase, mSize, MADV_SEQUENTIAL);
+
+    bool is_y4m = (mSize > 10 && memcmp(mBase, "YUV4MPEG2 ", 10) == 0);
+    if (is_y4m) {
+        // stream header and every frame header end with '\n'
+        const uint8_t* header_end = (const uint8_t*)memchr(mBase, '\n', std::min(mSize, size_t(1024)));
+        if (header_end == nullptr || !parse_y4m_header(std::string((const char*)mBase, header_end - mBase))) {
+            MNN_ERROR("Invalid Y4M header in %s\n", file_name.c_str());
+            close();
+            return false;
+        }
+
+        size_t frame_size = get_frame_size();
+        size_t pos = header_end - mBase + 1;
+        while (pos + 5 < mSize && memcmp(mBase + pos, "FRAME", 5) == 0) {
+            const uint8_t* frame_header_end = (const uint8_t*)memchr(mBase + pos, '\n', mSize - pos);
+            if (frame_header_end == nullptr) {
+                break;
+            }
+            size_t offset = frame_header_end - mBase + 1;
+            if (offset + frame_size > mSize) {
+                break;
+            }
+            mFrameOffsets.emplace_back(offset);
+            pos = offset + frame_size;
+        }
+    } else {
+        if (!parse_raw_format(raw_format)) {
+            MNN_ERROR("Invalid raw video format %s, should be like i420:1920x1080\n", raw_format.c_str());
+            close();
+            return false;
+        }
+        size_t frame_size = get_frame_size();
+        for (size_t offset = 0; offset + frame_size <= mSize; offset += frame_size) {
+            mFrameOffsets.emplace_back(offset);
+        }
+    }
+
+    if (mFrameOffsets.empty()) {
+        MNN_ERROR("No complete frame in video %s\n", file_name.c_str());
+        close();
+        return false;
+    }
+    return true;
+}
+
+
+static inline uint8_t clamp_pixel(int value)
+{
+    return uint8_t(std::min(std::max(value, 0), 255));
+}
+
+
+bool VideoReader::read_frame(int index, t_image_buffer& image)
+{
+    if (index < 0 || index >= frame_count()) {
+        return false;
+    }
+    const uint8_t* frame = mBase + mFrameOffsets[index];
+
+    image.width = mWidth;
+    image.height = mHeight;
+    image.channel = 3;
+    if (mFormat == PIXEL_RGB24) {
+        // model input is only read, so it's safe to point into the
+        // read-only mapping
+        image.data = const_cast<uint8_t*>(frame);
+        return true;
+    }
+
+    // BT.601 limited range YUV to RGB, in 8-bit fixed point
+    mRgbBuffer.resize(size_t(mWidth) * mHeight * 3);
+    int chroma_width = (mWidth + (1 << mChromaShiftX) - 1) >> mChromaShiftX;
+    int chroma_height = (mHeight + (1 << mChromaShiftY) - 1) >> mChromaShiftY;
+    const uint8_t* y_plane = frame;
+    const uint8_t* u_plane = y_plane + size_t(mWidth) * mHeight;
+    const uint8_t* v_plane = u_plane + size_t(chroma_width) * chroma_height;
+
+    for (int h = 0; h < mHeight; h++) {
+        const uint8_t* y_row = y_plane + size_t(h) * mWidth;
+        size_t chroma_row = size_t(h >> mChromaShiftY) * chroma_width;
+        uint8_t* rgb = mRgbBuffer.data() + size_t(h) * mWidth * 3;
+
+        for (int w = 0; w < mWidth; w++, rgb += 3) {
+            int c = 298 * (y_row[w] - 16);
+            int d = 0, e = 0;
+            if (mFormat == PIXEL_NV12) {
+                size_t uv = (chroma_row + (w >> 1)) * 2;
+                d = u_plane[uv] - 128;
+                e = u_plane[uv + 1] - 128;
+            } else if (mHasChroma) {
+                size_t uv = chroma_row + (w >> mChromaShiftX);
+                d = u_plane[uv] - 128;
+                e = v_plane[uv] - 128;
+            }
+            rgb[0] = clamp_pixel((c + 409 * e + 128) >> 8);
+            rgb[1] = clamp_pixel((c - 100 * d - 208 * e + 128) >> 8);
+            rgb[2] = clamp_pixel((c + 516 * d + 128) >> 8);
+        }
+    }
+
+    image.data = mRgbBuffer.data();
+    return true;
+}
@@ -0,0 +1,68 @@
+//
+//  videoReader.h
+//  MNN
+//
+//  Memory mapped reader of uncompressed video file (Y4M, raw
+//  YUV/RGB), for offline stream benchmark
+//
+
+#ifndef YOLO_DETECTION_VIDEO_READER_H_
+#define YOLO_DETECTION_VIDEO_READER_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "yoloDetection.h"
+
+
+// pixel layout of video frame
+enum PixelFormat {
+    PIXEL_YUV_PLANAR = 0,   // Y plane followed by U & V planes (I420, 422, 444), or Y only (mono)
+    PIXEL_NV12 = 1,         // Y plane followed by interleaved UV plane
+    PIXEL_RGB24 = 2,        // packed RGB888
+};
+
+
+class VideoReader {
+public:
+    VideoReader();
+    ~VideoReader();
+
+    // open Y4M file, whose header gives frame shape & format. other
+    // files are raw frames, with raw_format like "i420:1920x1080",
+    // "nv12:1280x720" or "rgb24:640x480"
+    bool open(const std::string& file_name, const std::string& raw_format);
+    void close();
+
+    int width() const { return mWidth; }
+    int height() const { return mHeight; }
+    int frame_count() const { return mFrameOffsets.size(); }
+    double fps() const { return mFps; }
+
+    // get RGB888 frame. RGB24 frame points into the mapped file
+    // directly, and YUV frame is converted into a reused buffer
+    // which is valid until next read
+    bool read_frame(int index, t_image_buffer& image);
+
+private:
+    bool parse_y4m_header(const std::string& header);
+    bool parse_raw_format(const std::string& raw_format);
+    size_t get_frame_size() const;
+
+    int mFd;
+    uint8_t* mBase;
+    size_t mSize;
+
+    int mWidth;
+    int mHeight;
+    double mFps;
+    PixelFormat mFormat;
+    bool mHasChroma;
+    int mChromaShiftX;                  // chroma subsampling, as log2 of ratio
+    int mChromaShiftY;
+
+    std::vector<size_t> mFrameOffsets;
+    std::vector<uint8_t> mRgbBuffer;
+};
+
+#endif  // YOLO_DETECTION_VIDEO_READER_H_
@@ -0,0 +1,387 @@
+//
+//  yoloBatch.cpp
+//  MNN
+//
+//  Batch detection on image directory, glob pattern or image
+//  list file, with images distributed across worker sessions
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+#include <glob.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+#include "MNN/Interpreter.hpp"
+#include "stb_image.h"
+
+#include "yoloDetection.h"
+#include "resultWriter.h"
+#include "yoloTracker.h"
+
+using namespace MNN;
+
+
+static bool has_image_extension(const std::string& file_name)
+{
+    const char* image_extensions[] = {".jpg", ".jpeg", ".png", ".bmp"};
+
+    size_t dot = file_name.rfind('.');
+    if (dot == std::string::npos) {
+        return false;
+    }
+    std::string extension = file_name.substr(dot);
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+    for (auto image_extension : image_extensions) {
+        if (extension == image_extension) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+bool is_batch_input(const std::string& input_name)
+{
+    struct stat input_stat;
+
+    // glob pattern
+    if (input_name.find_first_of("*?[") != std::string::npos) {
+        return true;
+    }
+    // image directory
+    if (stat(input_name.c_str(), &input_stat) == 0 && S_ISDIR(input_stat.st_mode)) {
+        return true;
+    }
+    // image list file
+    return input_name.size() > 4 && input_name.compare(input_name.size() - 4, 4, ".txt") == 0;
+}
+
+
+int get_image_list(const std::string& input_name, const std::string& image_dir, std::vector<std::string>& image_names)
+{
+    struct stat input_stat;
+
+    if (input_name.find_first_of("*?[") != std::string::npos) {
+        // glob pattern, e.g. "images/*.jpg"
+        glob_t glob_result;
+        if (glob(input_name.c_str(), 0, nullptr, &glob_result) == 0) {
+            for (size_t i = 0; i < glob_result.gl_pathc; i++) {
+                image_names.emplace_back(glob_result.gl_pathv[i]);
+            }
+        }
+        globfree(&glob_result);
+    }
+    else if (stat(input_name.c_str(), &input_stat) == 0 && S_ISDIR(input_stat.st_mode)) {
+        // all the image files in directory
+        DIR* dir = opendir(input_name.c_str());
+        if (dir == nullptr) {
+            MNN_ERROR("Can't open %s\n", input_name.c_str());
+            return -1;
+        }
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != nullptr) {
+            if (has_image_extension(entry->d_name)) {
+                image_names.emplace_back(input_name + "/" + entry->d_name);
+            }
+        }
+        closedir(dir);
+        std::sort(image_names.begin(), image_names.end());
+    }
+    else {
+        // image list file, which could be an annotation file
+        // (path/to/img1.jpg 50,100,150,200,0 ...) or an image
+        // id list (2012_000948), use 1st field of every line
+        std::ifstream listOs(input_name.c_str());
+        if (!listOs) {
+            MNN_ERROR("Can't open %s\n", input_name.c_str());
+            return -1;
+        }
+        std::string line;
+        while (std::getline(listOs, line)) {
+            std::istringstream line_stream(line);
+            std::string image_name;
+            if (!(line_stream >> image_name)) {
+                continue;
+            }
+            if (!has_image_extension(image_name)) {
+                image_name += ".jpg";
+            }
+            if (!image_dir.empty()) {
+                image_name = image_dir + "/" + image_name;
+            }
+            image_names.emplace_back(image_name);
+        }
+    }
+
+    return image_names.size();
+}
+
+
+void detect_image_workers(const std::vector<t_detect_worker*>& workers, const t_image_buffer& image,
+                          const int num_classes, const std::vector<std::pair<float, float>>& anchors,
+                          std::vector<t_prediction>& prediction_nms_list, Settings* s)
+{
+    if (s->tta_flip || !s->tta_sizes.empty()) {
+        detect_image_tta(workers[0], image, num_classes, anchors, prediction_nms_list, s);
+        return;
+    }
+    if (s->tiled) {
+        detect_image_tiled(workers, image, num_classes, anchors, prediction_nms_list, s);
+        return;
+    }
+
+    auto worker = workers[0];
+    int input_width = 0, input_height = 0;
+    if (s->rect_input) {
+        // default model input shape is the max shape for rectangular
+        // input. sessions for rectangular input shapes are cached,
+        // which are limited as the shape is stride 32 multiple
+        auto default_session = get_cached_session(worker->net.get(), s, worker->session_cache, num_classes, anchors, 1).session;
+        auto image_input = worker->net->getSessionInputAll(default_session).begin()->second;
+        get_rect_input_shape(image.width, image.height, image_input->width(), image_input->height(), input_width, input_height);
+    }
+    auto& session = get_cached_session(worker->net.get(), s, worker->session_cache, num_classes, anchors,
+                                       1, input_width, input_height);
+
+    detect_image(worker->net.get(), session.session, session.plan.get(), image.data, image.width, image.height, image.channel,
+                 num_classes, prediction_nms_list, s);
+    return;
+}
+
+
+int detect_image_list(const std::vector<std::string>& image_names, const int num_classes,
+                      const std::vector<std::pair<float, float>>& anchors,
+                      const t_detect_callback& callback, Settings* s)
+{
+    int num_images = image_names.size();
+
+    // create model & session for every worker, since
+    // MNN serializes runSession on one interpreter
+    int num_workers = std::max(1, std::min(s->number_of_workers, num_images));
+    std::vector<t_detect_worker> workers(num_workers);
+    for (auto& worker : workers) {
+        worker.net.reset(Interpreter::createFromFile(s->model_name.c_str()));
+        if (worker.net == nullptr) {
+            MNN_ERROR("Can't load model %s\n", s->model_name.c_str());
+            return -1;
+        }
+        get_cached_session(worker.net.get(), s, worker.session_cache, num_classes, anchors, 1);
+    }
+
+    // workers fetch next image index until the list is done,
+    // and hand over the result under lock
+    std::atomic<int> next_image(0);
+    int finish_count = 0;
+    std::mutex result_mutex;
+
+    auto worker = [&](int worker_index) {
+        int image_index;
+        while ((image_index = next_image++) < num_images) {
+            std::vector<t_prediction> prediction_nms_list;
+            int image_width, image_height, image_channel;
+            uint8_t* inputImage = (uint8_t*)stbi_load(image_names[image_index].c_str(), &image_width, &image_height, &image_channel, 3);
+            if (nullptr != inputImage) {
+                t_image_buffer image;
+                image.data = inputImage;
+                image.width = image_width;
+                image.height = image_height;
+                image.channel = 3;
+                detect_image_workers(std::vector<t_detect_worker*>(1, &workers[worker_index]), image,
+                                     num_classes, anchors, prediction_nms_list, s);
+                stbi_image_free(inputImage);
+            }
+
+            std::lock_guard<std::mutex> lock(result_mutex);
+            if (nullptr == inputImage) {
+                fprintf(stderr, "Can't open %s\n", image_names[image_index].c_str());
+                image_width = 0;
+                image_height = 0;
+            }
+            callback(image_index, image_width, image_height, prediction_nms_list);
+
+            finish_count++;
+            if (finish_count % 100 == 0 || finish_count == num_images) {
+                // progress to stderr, as results could be streamed to stdout
+                fprintf(stderr, "processed images: %d/%d\n", finish_count, num_images);
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_workers; i++) {
+        threads.emplace_back(worker, i);
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    return num_workers;
+}
+
+
+void RunBatchInference(Settings* s) {
+    // record run time for every stage
+    struct timeval start_time, stop_time;
+
+    // get classes labels & anchor value
+    std::vector<std::string> classes;
+    std::vector<std::pair<float, float>> anchors;
+    load_classes_anchors(s, classes, anchors);
+    int num_classes = classes.size();
+
+    // text result goes to stdout by default, so logs of batch mode
+    // are all printed to stderr
+    fprintf(stderr, "num_classes: %d\n", num_classes);
+
+    std::vector<std::string> image_names;
+    if (get_image_list(s->input_img_name, s->image_dir, image_names) <= 0) {
+        MNN_ERROR("No image found in %s\n", s->input_img_name.c_str());
+        return;
+    }
+    int num_images = image_names.size();
+    fprintf(stderr, "image number: %d\n", num_images);
+
+    // stream detection result of all images into one file, or text
+    // result to stdout
+    std::unique_ptr<ResultWriter> result_writer;
+    FILE* result_file = nullptr;
+    if (!open_result_writer(s->result_file_name, s->result_format, classes, result_writer, result_file)) {
+        return;
+    }
+    if (result_file == stdout && s->result_format != "text") {
+        fprintf(stderr, "%s result need a --result_file\n", s->result_format.c_str());
+        close_result_writer(result_writer, result_file);
+        return;
+    }
+
+    int num_detections = 0;
+
+    // for tracking, images are regarded as frames of a video, so results
+    // finished out of order by parallel workers are held and fed to
+    // tracker in image order
+    Tracker tracker;
+    std::map<int, std::tuple<int, int, std::vector<t_prediction>>> pending_results;
+    int next_index = 0;
+
+    // failed image is still written as a 0x0 record with no object,
+    // so image index of the result stream stays aligned with the list
+    auto write_result = [&](int image_index, int image_width, int image_height, std::vector<t_prediction>& prediction_nms_list) {
+        if (s->track && image_width > 0) {
+            std::vector<t_prediction> tracked_list;
+            tracker.update(prediction_nms_list, tracked_list);
+            prediction_nms_list.swap(tracked_list);
+        }
+        result_writer->write(image_names[image_index], image_index, image_width, image_height, prediction_nms_list);
+        num_detections += prediction_nms_list.size();
+    };
+
+    gettimeofday(&start_time, nullptr);
+    int num_workers = detect_image_list(image_names, num_classes, anchors,
+        [&](int image_index, int image_width, int image_height, std::vector<t_prediction>& prediction_nms_list) {
+            if (!s->track) {
+                write_result(image_index, image_width, image_height, prediction_nms_list);
+                return;
+            }
+            pending_results[image_index] = std::make_tuple(image_width, image_height, std::move(prediction_nms_list));
+            for (auto iter = pending_results.begin(); iter != pending_results.end() && iter->first == next_index;
+                 iter = pending_results.erase(iter), next_index++) {
+                write_result(iter->first, std::get<0>(iter->second), std::get<1>(iter->second), std::get<2>(iter->second));
+            }
+        }, s);
+    gettimeofday(&stop_time, nullptr);
+
+    close_result_writer(result_writer, result_file);
+    if (num_workers < 0) {
+        return;
+    }
+
+    double total_ms = (get_us(stop_time) - get_us(start_time)) / 1000;
+    fprintf(stderr, "batch detection time: %lf ms, %d workers, %lf images/s, %d objects detected\n",
+            total_ms, num_workers, num_images * 1000 / total_ms, num_detections);
+
+    return;
+}
+
+
+void RunWorkerInference(Settings* s) {
+    // record run time for every stage
+    struct timeval start_time, stop_time;
+
+    // get classes labels & anchor value
+    std::vector<std::string> classes;
+    std::vector<std::pair<float, float>> anchors;
+    load_classes_anchors(s, classes, anchors);
+    int num_classes = classes.size();
+    MNN_PRINT("num_classes: %d\n", num_classes);
+
+    // create model for every worker, since MNN serializes
+    // runSession on one interpreter
+    int num_workers = std::max(1, s->number_of_workers);
+    std::vector<t_detect_worker> workers(num_workers);
+    std::vector<t_detect_worker*> worker_ptrs;
+    for (auto& worker : workers) {
+        worker.net.reset(Interpreter::createFromFile(s->model_name.c_str()));
+        if (worker.net == nullptr) {
+            MNN_ERROR("Can't load model %s\n", s->model_name.c_str());
+            return;
+        }
+        worker_ptrs.emplace_back(&worker);
+    }
+
+    // load input image
+    t_image_buffer image;
+    image.data = (uint8_t*)stbi_load(s->input_img_name.c_str(), &image.width, &image.height, &image.channel, 3);
+    image.channel = 3;
+    if (nullptr == image.data) {
+        MNN_ERROR("Can't open %s\n", s->input_img_name.c_str());
+        return;
+    }
+    MNN_PRINT("origin image size: width:%d, height:%d\n", image.width, image.height);
+
+    // run warm up detection. sessions of tile/TTA batches & sizes and
+    // their head plans are created on first use, so at least once
+    std::vector<t_prediction> prediction_nms_list;
+    for (int i = 0; i < std::max(1, s->number_of_warmup_runs); i++) {
+        prediction_nms_list.clear();
+        detect_image_workers(worker_ptrs, image, num_classes, anchors, prediction_nms_list, s);
+    }
+
+    gettimeofday(&start_time, nullptr);
+    for (int i = 0; i < s->loop_count; i++) {
+        prediction_nms_list.clear();
+        detect_image_workers(worker_ptrs, image, num_classes, anchors, prediction_nms_list, s);
+    }
+    gettimeofday(&stop_time, nullptr);
+    MNN_PRINT("detection average time: %lf ms\n", (get_us(stop_time) - get_us(start_time)) / (1000 * s->loop_count));
+    stbi_image_free(image.data);
+
+    // Show detection result
+    MNN_PRINT("Detection result:\n");
+    for(auto prediction_nms : prediction_nms_list) {
+        MNN_PRINT("%s %f (%d, %d) (%d, %d)\n", classes[prediction_nms.class_index].c_str(), prediction_nms.confidence, int(prediction_nms.x), int(prediction_nms.y), int(prediction_nms.x + prediction_nms.width), int(prediction_nms.y + prediction_nms.height));
+    }
+
+    // Save structured detection result
+    std::unique_ptr<ResultWriter> result_writer;
+    FILE* result_file = nullptr;
+    if (!s->result_file_name.empty() &&
+        open_result_writer(s->result_file_name, s->result_format, classes, result_writer, result_file)) {
+        result_writer->write(s->input_img_name, 0, image.width, image.height, prediction_nms_list);
+        close_result_writer(result_writer, result_file);
+    }
+
+    return;
+}
@@ -13,6 +13,7 @@
 #include <fstream>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <sstream>
 #include <iostream>
 #include <vector>
@@ -29,60 +30,22 @@
 #define STB_IMAGE_RESIZE_IMPLEMENTATION
 #include "stb_image_resize.h"
 
+#include "yoloDetection.h"
+#include "yoloHead.h"
+#include "yoloKernels.h"
+#include "resultWriter.h"
+#include "yoloServer.h"
+
 using namespace MNN;
 using namespace MNN::CV;
 
 
-// definition of a bbox prediction record
-typedef struct prediction {
-    float x;
-    float y;
-    float width;
-    float height;
-    float confidence;
-    int class_index;
-}t_prediction;
-
-
-// model inference settings
-struct Settings {
-  int loop_count = 1;
-  int number_of_threads = 4;
-  int number_of_warmup_runs = 2;
-  float input_mean = 0.0f;
-  float input_std = 255.0f;
-  std::string model_name = "./model.mnn";
-  std::string input_img_name = "./dog.jpg";
-  std::string classes_file_name = "./classes.txt";
-  std::string anchors_file_name = "./yolo3_anchors.txt";
-  bool input_floating = false;
-  //bool verbose = false;
-  //string input_layer_type = "uint8_t";
-};
-
-
 float sigmoid(float x)
 {
     return (1 / (1 + exp(-x)));
 }
 
 
-void softmax(const std::vector<float> &logits, std::vector<float> &output){
-    float sum=0.0;
-    output.clear();
-
-    for(size_t i = 0; i<logits.size(); ++i) {
-        output.emplace_back(exp(logits[i]));
-    }
-    sum = std::accumulate(output.begin(), output.end(), sum);
-
-    for(size_t i = 0; i<output.size(); ++i) {
-        output[i] /= sum;
-    }
-    return;
-}
-
-
 double get_us(struct timeval t)
 {
     return (t.tv_sec * 1000000 + t.tv_usec);
@@ -93,24 +56,264 @@ void display_usage() {
     std::cout
         << "Usage: yoloDetection\n"
         << "--mnn_model, -m: model_name.mnn\n"
-        << "--image, -i: image_name.jpg\n"
+        << "--image, -i: image_name.jpg, or image directory/glob pattern/list file for batch detection\n"
+        << "--image_dir, -d: image directory prefix for entries of image list file\n"
+        << "--result_file, -o: output file for detection result, default stdout for batch detection\n"
+        << "--result_format, -g: [text|json|binary] format of detection result file, default text\n"
         << "--classes, -l: classes labels for the model\n"
         << "--anchors, -a: anchor values for the model\n"
+        << "--head_config, -H: head config of output layers (anchor mask, stride, scoring), could be darknet cfg of the model. default split anchors evenly to layers\n"
         << "--input_mean, -b: input mean\n"
         << "--input_std, -s: input standard deviation\n"
         << "--threads, -t: number of threads\n"
         << "--count, -c: loop model run for certain times\n"
         << "--warmup_runs, -w: number of warmup runs\n"
+        << "--conf_threshold, -r: confidence threshold for filtering boxes, default 0.1\n"
+        << "--iou_threshold, -u: IoU threshold for NMS, default 0.4\n"
+        << "--annotation_file, -e: annotation txt file to evaluate model mAP on, like eval.py\n"
+        << "--eval_type, -y: evaluation type (VOC/COCO), default VOC\n"
+        << "--eval_iou_threshold, -p: IoU threshold for PascalVOC mAP, default 0.5\n"
+        << "--workers, -j: number of parallel model sessions for evaluation/batch detection\n"
+        << "--server, -x: run detection server on Unix socket path, or localhost TCP port if numeric\n"
+        << "--max_batch, -n: max batch size of detection server, default 4\n"
+        << "--batch_timeout, -z: max wait time (ms) to form up a batch in detection server, default 5\n"
+        << "--shm_ring, -k: run detection on shared memory frame ring <name>_frames, publish to <name>_results\n"
+        << "--model_image_size, -q: model input size like 416 or 608x352, default the model input shape\n"
+        << "--rect_input, -R: [0|1] use minimal rectangular input of stride 32 multiple for image shape, within model_image_size\n"
+        << "--tiled, -T: [0|1] detect large image with overlapping model-sized tiles\n"
+        << "--tile_overlap, -O: overlap ratio between tiles, default 0.2\n"
+        << "--tta, -A: test-time augmentation variants, \"flip\" and/or input sizes like flip,320,608\n"
+        << "--tta_merge, -M: [wbf|nms] merge method of TTA predictions, default wbf\n"
+        << "--track, -K: [0|1] track objects across frames of image sequence, server connection or shm source\n"
+        << "--video, -V: Y4M or raw YUV/RGB video file for stream benchmark\n"
+        << "--video_format, -F: frame format and size of raw video, like i420:1920x1080, nv12:1280x720 or rgb24:640x480\n"
+        << "--motion_gate, -G: [0|1] detect only moving regions of server connection or shm source frames, for static camera\n"
+        << "--precision, -C: [normal|high|low] backend precision mode, low for fp16/bf16 arithmetic on supporting CPU, default normal\n"
+        << "--power, -W: [normal|high|low] backend power mode, default normal\n"
+        << "--memory, -E: [normal|high|low] backend memory mode, default normal\n"
+        << "--preprocess, -P: [stb|mnn] image preprocess with stb resize, or MNN ImageProcess in one pass, default stb\n"
+        << "--cpu_kernel, -X: [auto|generic|sse4.1|avx2|avx512|neon] force CPU variant of pre/postprocess kernels for benchmark, default auto\n"
+        << "--skip_frames, -S: max frame interval of full detection for server connection or shm source, with tracker prediction on skipped frames. default 0 (no skip)\n"
         //<< "--verbose, -v: [0|1] print more information\n"
         << "\n";
     return;
 }
 
 
+// feature map layouts for decode loop. cell() is the offset of grid
+// point (h, w) and channel() the offset of channel c from the cell, so
+// with the layout as template param the index math is known at compile
+// time and strength-reduced. channel() is only linear for NHWC/NCHW,
+// so it always takes the absolute channel index
+struct layout_nhwc {
+    // class scores of an anchor are contiguous
+    static constexpr bool contiguous = true;
+    // every channel is a contiguous plane
+    static constexpr bool planar = false;
+
+    layout_nhwc(int height, int width, int channel) : mWidth(width), mChannel(channel) {}
+    inline int cell(int h, int w) const { return (h * mWidth + w) * mChannel; }
+    inline int channel(int c) const { return c; }
+
+    int mWidth, mChannel;
+};
+
+struct layout_nchw {
+    static constexpr bool contiguous = false;
+    static constexpr bool planar = true;
+
+    layout_nchw(int height, int width, int channel) : mWidth(width), mArea(height * width) {}
+    inline int cell(int h, int w) const { return h * mWidth + w; }
+    inline int channel(int c) const { return c * mArea; }
+
+    int mWidth, mArea;
+};
+
+// MNN native NC4HW4: channels are packed in groups of 4, and the 4
+// channels of a grid point are contiguous
+struct layout_nc4hw4 {
+    static constexpr bool contiguous = false;
+    static constexpr bool planar = false;
+
+    layout_nc4hw4(int height, int width, int channel) : mWidth(width), mArea(height * width) {}
+    inline int cell(int h, int w) const { return (h * mWidth + w) * 4; }
+    inline int channel(int c) const { return (c >> 2) * mArea * 4 + (c & 3); }
+
+    int mWidth, mArea;
+};
+
+
+// decode one anchor of a grid point, and push the prediction if its
+// confidence pass the threshold
+template <class Layout, int HeadType>
+static inline void yolo_decode_anchor(const Layout& layout, const float* cell, const int anc, const float grid_x, const float grid_y,
+                                      const t_head_layer& layer, const int num_classes, const t_kernel_table* kernels,
+                                      std::vector<t_prediction> &prediction_list, float conf_threshold)
+{
+    //get bbox prediction data for each anchor, each feature point
+    const int bbox_channel = anc * (num_classes + 5);
+    const int bbox_scores_channel = bbox_channel + 5;
+
+    float bbox_obj = sigmoid(cell[layout.channel(bbox_channel + 4)]);
+
+    // get max class score on logits, since both sigmoid & softmax
+    // are monotonic, and only convert the max one
+    int max_index = 0;
+    float max_logit;
+    if (Layout::contiguous) {
+        max_logit = kernels->max_index(cell + layout.channel(bbox_scores_channel), num_classes, &max_index);
+    } else {
+        max_logit = cell[layout.channel(bbox_scores_channel)];
+        for (int i = 1; i < num_classes; i++) {
+            float logit = cell[layout.channel(bbox_scores_channel + i)];
+            if (logit > max_logit) {
+                max_logit = logit;
+                max_index = i;
+            }
+        }
+    }
+
+    //get anchor output confidence (class_score * objectness) and filter with threshold
+    float max_conf;
+    if (HeadType == HEAD_SOFTMAX) {
+        // max softmax score = 1 / sum(exp(logit - max_logit))
+        float sum = 0.0;
+        for (int i = 0; i < num_classes; i++) {
+            sum += exp(cell[layout.channel(bbox_scores_channel + i)] - max_logit);
+        }
+        max_conf = bbox_obj / sum;
+    } else {
+        max_conf = sigmoid(max_logit) * bbox_obj;
+    }
+    if (max_conf < conf_threshold) {
+        return;
+    }
+
+    // box in input pixels: grid offset & anchor size are
+    // in pixels in head plan
+    const float stride = layer.stride;
+    float bbox_x = sigmoid(cell[layout.channel(bbox_channel)]) * stride + grid_x;
+    float bbox_y = sigmoid(cell[layout.channel(bbox_channel + 1)]) * stride + grid_y;
+    float bbox_w = exp(cell[layout.channel(bbox_channel + 2)]) * layer.anchors[anc].first;
+    float bbox_h = exp(cell[layout.channel(bbox_channel + 3)]) * layer.anchors[anc].second;
+
+    // got a valid prediction, form up data and push to result vector
+    // with centoids converted to top left coordinates
+    t_prediction bbox_prediction;
+    bbox_prediction.x = bbox_x - (bbox_w / 2);
+    bbox_prediction.y = bbox_y - (bbox_h / 2);
+    bbox_prediction.width = bbox_w;
+    bbox_prediction.height = bbox_h;
+    bbox_prediction.confidence = max_conf;
+    bbox_prediction.class_index = max_index;
+    bbox_prediction.track_id = -1;
+
+    prediction_list.emplace_back(bbox_prediction);
+    return;
+}
+
+
+// two-phase decode of planar layout (NCHW), where channels of a grid
+// point are a whole plane apart. confidence never exceeds objectness,
+// so the contiguous objectness plane of each anchor is scanned with
+// SIMD for candidate cells first, and box & class channels are only
+// gathered for the few candidates
+template <class Layout, int HeadType, int AnchorNum>
+static void yolo_decode_sparse(const Layout& layout, const float* bytes, const t_head_layer& layer, const int num_classes,
+                               const t_kernel_table* kernels, std::vector<t_prediction> &prediction_list, float conf_threshold)
+{
+    const int anchor_num_per_layer = (AnchorNum > 0) ? AnchorNum : layer.anchors.size();
+    const int anchor_channel = num_classes + 5;
+    const int area = layer.height * layer.width;
+
+    // sigmoid(obj_logit) >= conf_threshold on logit, with a margin for
+    // rounding of sigmoid. the exact check is still done in decode
+    const float obj_threshold = logf(conf_threshold / (1.0f - conf_threshold)) - 1e-3f;
+
+    // candidate is (cell * anchor_num + anchor), sorted to keep the
+    // prediction order of dense decode
+    thread_local std::vector<int> indices;
+    thread_local std::vector<int> candidates;
+    indices.resize(area);
+    candidates.clear();
+
+    for (int anc = 0; anc < anchor_num_per_layer; anc++) {
+        const float* obj_plane = bytes + layout.channel(anc * anchor_channel + 4);
+        int num = kernels->threshold_index(obj_plane, area, obj_threshold, indices.data());
+        for (int i = 0; i < num; i++) {
+            candidates.emplace_back(indices[i] * anchor_num_per_layer + anc);
+        }
+    }
+    if (anchor_num_per_layer > 1) {
+        std::sort(candidates.begin(), candidates.end());
+    }
+
+    for (auto candidate : candidates) {
+        const int index = candidate / anchor_num_per_layer;
+        const int anc = candidate - index * anchor_num_per_layer;
+        const int h = index / layer.width;
+        const int w = index - h * layer.width;
+
+        yolo_decode_anchor<Layout, HeadType>(layout, bytes + layout.cell(h, w), anc, layer.grid_x[w], layer.grid_y[h],
+                                             layer, num_classes, kernels, prediction_list, conf_threshold);
+    }
+    return;
+}
+
+
+// decode loop of one feature map, specialized on layout, head type
+// and anchor number (0 for runtime anchor number). stride, anchor
+// sizes & grid offsets come from the head plan of the layer
+template <class Layout, int HeadType, int AnchorNum>
+static void yolo_decode(const Layout& layout, const float* bytes, const t_head_layer& layer, const int num_classes,
+                        const t_kernel_table* kernels, std::vector<t_prediction> &prediction_list, float conf_threshold)
+{
+    // planar layout with a usable objectness threshold goes sparse
+    if (Layout::planar && conf_threshold > 0.0f && conf_threshold < 1.0f) {
+        yolo_decode_sparse<Layout, HeadType, AnchorNum>(layout, bytes, layer, num_classes, kernels, prediction_list, conf_threshold);
+        return;
+    }
+
+    const int anchor_num_per_layer = (AnchorNum > 0) ? AnchorNum : layer.anchors.size();
+
+    for (int h = 0; h < layer.height; h++) {
+        const float grid_y = layer.grid_y[h];
+        for (int w = 0; w < layer.width; w++) {
+            const float grid_x = layer.grid_x[w];
+            const float* cell = bytes + layout.cell(h, w);
+
+            for (int anc = 0; anc < anchor_num_per_layer; anc++) {
+                yolo_decode_anchor<Layout, HeadType>(layout, cell, anc, grid_x, grid_y,
+                                                     layer, num_classes, kernels, prediction_list, conf_threshold);
+            }
+        }
+    }
+    return;
+}
+
+
+// dispatch head type & common anchor numbers out of the decode loop
+template <class Layout>
+static void yolo_decode_dispatch(const Layout& layout, const float* bytes, const t_head_layer& layer, const int num_classes,
+                                 const t_kernel_table* kernels, std::vector<t_prediction> &prediction_list, float conf_threshold)
+{
+    if (layer.head_type == HEAD_SOFTMAX && layer.anchors.size() == 5) {
+        // YOLOv2 use 5 anchors and softmax class scores
+        yolo_decode<Layout, HEAD_SOFTMAX, 5>(layout, bytes, layer, num_classes, kernels, prediction_list, conf_threshold);
+    } else if (layer.head_type == HEAD_SOFTMAX) {
+        yolo_decode<Layout, HEAD_SOFTMAX, 0>(layout, bytes, layer, num_classes, kernels, prediction_list, conf_threshold);
+    } else if (layer.anchors.size() == 3) {
+        yolo_decode<Layout, HEAD_SIGMOID, 3>(layout, bytes, layer, num_classes, kernels, prediction_list, conf_threshold);
+    } else {
+        yolo_decode<Layout, HEAD_SIGMOID, 0>(layout, bytes, layer, num_classes, kernels, prediction_list, conf_threshold);
+    }
+    return;
+}
+
+
 // YOLO postprocess for each prediction feature map
-void yolo_postprocess(const Tensor* feature_map, const int input_width, const int input_height,
-                      const int num_classes, const std::vector<std::pair<float, float>> anchors,
-                      std::vector<t_prediction> &prediction_list, float conf_threshold)
+void yolo_postprocess(const Tensor* feature_map, const int batch_index, const t_head_layer& layer,
+                      const int num_classes, std::vector<t_prediction> &prediction_list, float conf_threshold)
 {
     // 1. do following transform to get the output bbox,
     //    which is aligned with YOLOv3/YOLOv2 paper:
@@ -154,137 +357,49 @@ void yolo_postprocess(const Tensor* feature_map, const int input_width, const in
     auto height  = feature_map->height();
     auto width   = feature_map->width();
 
-    int stride = input_width / width;
     auto unit = sizeof(float);
-    int anchor_num_per_layer = anchors.size();
 
-    // now we only support single image postprocess
-    MNN_ASSERT(batch == 1);
+    // feature map should match the head plan
+    MNN_ASSERT(width == layer.width && height == layer.height && channel == layer.channel);
+
+    const t_kernel_table* kernels = get_kernels();
 
-    // the featuremap channel should be like 3*(num_classes + 5)
-    MNN_ASSERT(anchor_num_per_layer * (num_classes + 5) == channel);
+    // postprocess one image of the batch each time
+    MNN_ASSERT(batch_index < batch);
 
     int bytesPerRow, bytesPerImage, bytesPerBatch;
     if (dimType == Tensor::TENSORFLOW) {
         // Tensorflow format tensor, NHWC
-        MNN_PRINT("Tensorflow format: NHWC\n");
-
         bytesPerRow   = channel * unit;
         bytesPerImage = width * bytesPerRow;
         bytesPerBatch = height * bytesPerImage;
 
     } else if (dimType == Tensor::CAFFE) {
         // Caffe format tensor, NCHW
-        MNN_PRINT("Caffe format: NCHW\n");
-
         bytesPerRow   = width * unit;
         bytesPerImage = height * bytesPerRow;
         bytesPerBatch = channel * bytesPerImage;
 
     } else if (dimType == Tensor::CAFFE_C4) {
-        MNN_PRINT("Caffe format: NC4HW4, not supported\n");
-        exit(-1);
+        // Caffe format tensor with MNN channel packing, NC4HW4
+        bytesPerRow   = width * 4 * unit;
+        bytesPerImage = height * bytesPerRow;
+        bytesPerBatch = ((channel + 3) / 4) * bytesPerImage;
+
     } else {
         MNN_PRINT("Invalid tensor dim type: %d\n", dimType);
         exit(-1);
     }
 
-    for (int b = 0; b < batch; b++) {
-        auto bytes = data + b * bytesPerBatch / unit;
-        MNN_PRINT("batch %d:\n", b);
-
-        for (int h = 0; h < height; h++) {
-            for (int w = 0; w < width; w++) {
-                for (int anc = 0; anc < anchor_num_per_layer; anc++) {
-                    //get bbox prediction data offset for each anchor, each feature point
-                    int bbox_x_offset, bbox_y_offset, bbox_w_offset, bbox_h_offset, bbox_obj_offset, bbox_scores_offset, bbox_scores_step;
-                    if (dimType == Tensor::TENSORFLOW) {
-                        // Tensorflow format tensor, NHWC
-                        bbox_x_offset = h * width * channel + w * channel + anc * (num_classes + 5);
-                        bbox_y_offset = h * width * channel + w * channel + anc * (num_classes + 5) + 1;
-                        bbox_w_offset = h * width * channel + w * channel + anc * (num_classes + 5) + 2;
-                        bbox_h_offset = h * width * channel + w * channel + anc * (num_classes + 5) + 3;
-                        bbox_obj_offset = h * width * channel + w * channel + anc * (num_classes + 5) + 4;
-                        bbox_scores_offset = h * width * channel + w * channel + anc * (num_classes + 5) + 5;
-                        bbox_scores_step = 1;
-
-                    } else if (dimType == Tensor::CAFFE) {
-                        // Caffe format tensor, NCHW
-                        bbox_x_offset = anc * (num_classes + 5) * width * height + h * width + w;
-                        bbox_y_offset = (anc * (num_classes + 5) + 1) * width * height + h * width + w;
-                        bbox_w_offset = (anc * (num_classes + 5) + 2) * width * height + h * width + w;
-                        bbox_h_offset = (anc * (num_classes + 5) + 3) * width * height + h * width + w;
-                        bbox_obj_offset = (anc * (num_classes + 5) + 4) * width * height + h * width + w;
-                        bbox_scores_offset = (anc * (num_classes + 5) + 5) * width * height + h * width + w;
-                        bbox_scores_step = width * height;
-
-                    } else if (dimType == Tensor::CAFFE_C4) {
-                        MNN_PRINT("Caffe format: NC4HW4, not supported\n");
-                        exit(-1);
-                    } else {
-                        MNN_PRINT("Invalid tensor dim type: %d\n", dimType);
-                        exit(-1);
-                    }
-
-                    float bbox_x = sigmoid(bytes[bbox_x_offset]) + w;
-                    float bbox_y = sigmoid(bytes[bbox_y_offset]) + h;
-                    float bbox_w = exp(bytes[bbox_w_offset]) * anchors[anc].first / stride;
-                    float bbox_h = exp(bytes[bbox_h_offset]) * anchors[anc].second / stride;
-                    float bbox_obj = sigmoid(bytes[bbox_obj_offset]);
-
-                    // Transfer anchor coordinates
-                    bbox_x = bbox_x * stride;
-                    bbox_y = bbox_y * stride;
-                    bbox_w = bbox_w * stride;
-                    bbox_h = bbox_h * stride;
-
-                    // Convert centoids to top left coordinates
-                    bbox_x = bbox_x - (bbox_w / 2);
-                    bbox_y = bbox_y - (bbox_h / 2);
-
-                    // Get softmax score for YOLOv2 prediction
-                    std::vector<float> logits_bbox_score;
-                    std::vector<float> bbox_score;
-                    if(anchor_num_per_layer == 5) {
-                        for (int i = 0; i < num_classes; i++) {
-                            logits_bbox_score.emplace_back(bytes[bbox_scores_offset + i * bbox_scores_step]);
-                        }
-                        softmax(logits_bbox_score, bbox_score);
-                    }
+    auto bytes = data + batch_index * bytesPerBatch / unit;
 
-                    //get anchor output confidence (class_score * objectness) and filter with threshold
-                    float max_conf = 0.0;
-                    int max_index = -1;
-                    for (int i = 0; i < num_classes; i++) {
-                        float tmp_conf = 0.0;
-                        if(anchor_num_per_layer == 5) {
-                            // YOLOv2 use 5 anchors and softmax class scores
-                            tmp_conf = bbox_score[i] * bbox_obj;
-                        }
-                        else {
-                            tmp_conf = sigmoid(bytes[bbox_scores_offset + i * bbox_scores_step]) * bbox_obj;
-                        }
-
-                        if(tmp_conf > max_conf) {
-                            max_conf = tmp_conf;
-                            max_index = i;
-                        }
-                    }
-                    if(max_conf >= conf_threshold) {
-                        // got a valid prediction, form up data and push to result vector
-                        t_prediction bbox_prediction;
-                        bbox_prediction.x = bbox_x;
-                        bbox_prediction.y = bbox_y;
-                        bbox_prediction.width = bbox_w;
-                        bbox_prediction.height = bbox_h;
-                        bbox_prediction.confidence = max_conf;
-                        bbox_prediction.class_index = max_index;
-
-                        prediction_list.emplace_back(bbox_prediction);
-                    }
-                }
-            }
-        }
+    // pick the decode loop specialization once for the feature map
+    if (dimType == Tensor::TENSORFLOW) {
+        yolo_decode_dispatch(layout_nhwc(height, width, channel), bytes, layer, num_classes, kernels, prediction_list, conf_threshold);
+    } else if (dimType == Tensor::CAFFE) {
+        yolo_decode_dispatch(layout_nchw(height, width, channel), bytes, layer, num_classes, kernels, prediction_list, conf_threshold);
+    } else {
+        yolo_decode_dispatch(layout_nc4hw4(height, width, channel), bytes, layer, num_classes, kernels, prediction_list, conf_threshold);
     }
 
     return;
@@ -336,7 +451,6 @@ bool compare_conf(t_prediction lpred, t_prediction rpred)
 // NMS operation for the prediction list
 void nms_boxes(const std::vector<t_prediction> prediction_list, std::vector<t_prediction>& prediction_nms_list, int num_classes, float iou_threshold)
 {
-    MNN_PRINT("prediction_list size before NMS: %lu\n", prediction_list.size());
     //go through every class
     for (int i = 0; i < num_classes; i++) {
 
@@ -380,71 +494,6 @@ void nms_boxes(const std::vector<t_prediction> prediction_list, std::vector<t_pr
 }
 
 
-// select anchorset for corresponding featuremap layer
-std::vector<std::pair<float, float>> get_anchorset(std::vector<std::pair<float, float>> anchors, const int feature_width, const int input_width)
-{
-    std::vector<std::pair<float, float>> anchorset;
-    int anchor_num = anchors.size();
-
-    // stride could confirm the feature map level:
-    // image_input: 1 x 416 x 416 x 3
-    // stride 32: 1 x 13 x 13 x 3 x (num_classes + 5)
-    // stride 16: 1 x 26 x 26 x 3 x (num_classes + 5)
-    // stride 8: 1 x 52 x 52 x 3 x (num_classes + 5)
-    int stride = input_width / feature_width;
-
-    // YOLOv3 model has 9 anchors and 3 feature layers
-    if (anchor_num == 9) {
-        if (stride == 32) {
-            anchorset.emplace_back(anchors[6]);
-            anchorset.emplace_back(anchors[7]);
-            anchorset.emplace_back(anchors[8]);
-        }
-        else if (stride == 16) {
-            anchorset.emplace_back(anchors[3]);
-            anchorset.emplace_back(anchors[4]);
-            anchorset.emplace_back(anchors[5]);
-        }
-        else if (stride == 8) {
-            anchorset.emplace_back(anchors[0]);
-            anchorset.emplace_back(anchors[1]);
-            anchorset.emplace_back(anchors[2]);
-        }
-        else {
-            MNN_PRINT("invalid feature map stride for anchorset!\n");
-            exit(-1);
-        }
-    }
-    // Tiny YOLOv3 model has 6 anchors and 2 feature layers
-    else if (anchor_num == 6) {
-        if (stride == 32) {
-            anchorset.emplace_back(anchors[3]);
-            anchorset.emplace_back(anchors[4]);
-            anchorset.emplace_back(anchors[5]);
-        }
-        else if (stride == 16) {
-            anchorset.emplace_back(anchors[0]);
-            anchorset.emplace_back(anchors[1]);
-            anchorset.emplace_back(anchors[2]);
-        }
-        else {
-            MNN_PRINT("invalid anchorset index!\n");
-            exit(-1);
-        }
-    }
-    // YOLOv2 model has 5 anchors and 1 feature layers
-    else if (anchor_num == 5) {
-        anchorset = anchors;
-    }
-    else {
-        MNN_PRINT("invalid anchor numbers!\n");
-        exit(-1);
-    }
-
-    return anchorset;
-}
-
-
 void parse_anchors(std::string line, std::vector<std::pair<float, float>>& anchors)
 {
     // parse anchor definition txt file
@@ -487,30 +536,73 @@ void parse_anchors(std::string line, std::vector<std::pair<float, float>>& ancho
 }
 
 
-void adjust_boxes(std::vector<t_prediction> &prediction_nms_list, int image_width, int image_height, int input_width, int input_height)
+void load_classes_anchors(Settings* s, std::vector<std::string>& classes,
+                          std::vector<std::pair<float, float>>& anchors)
 {
-    // Rescale the final prediction (letterboxed) back to original image
-    MNN_ASSERT(input_width == input_height);
+    // get classes labels
+    std::ifstream classesOs(s->classes_file_name.c_str());
+    std::string line;
+    while (std::getline(classesOs, line)) {
+        classes.emplace_back(line);
+    }
+
+    // get anchor value
+    std::ifstream anchorsOs(s->anchors_file_name.c_str());
+    while (std::getline(anchorsOs, line)) {
+        parse_anchors(line, anchors);
+    }
+    return;
+}
 
-    int square_dim = std::max(image_width, image_height);
-    float scale = float(square_dim) / float(input_width);
-    int x_offset, y_offset;
 
-    if ( image_width > image_height ) {
-        x_offset = 0;
-        y_offset = floor((image_width - image_height) / 2);
+// get letterbox image shape, which pads the short side of origin
+// image to aspect ratio of model input, so that the letterbox image
+// could be resized to model input without distortion
+void get_letterbox_shape(int image_width, int image_height, int input_width, int input_height,
+                         int& letterbox_width, int& letterbox_height)
+{
+    if (int64_t(image_width) * input_height >= int64_t(image_height) * input_width) {
+        letterbox_width = image_width;
+        letterbox_height = (int64_t(image_width) * input_height + input_width - 1) / input_width;
     }
     else {
-        x_offset = floor((image_height - image_width) / 2);
-        y_offset = 0;
+        letterbox_width = (int64_t(image_height) * input_width + input_height - 1) / input_height;
+        letterbox_height = image_height;
     }
+    return;
+}
+
 
+// get minimal model input shape of stride 32 multiple to fit in the
+// image with unchanged aspect ratio, within max input width/height.
+// e.g. 1920x1080 image with max 608x608 input gets 608x352 input
+void get_rect_input_shape(int image_width, int image_height, int max_input_width, int max_input_height,
+                          int& input_width, int& input_height)
+{
+    float scale = std::min(float(max_input_width) / image_width, float(max_input_height) / image_height);
+
+    input_width = std::min(max_input_width, int(ceil(image_width * scale / 32)) * 32);
+    input_height = std::min(max_input_height, int(ceil(image_height * scale / 32)) * 32);
+    return;
+}
+
+
+void adjust_boxes(std::vector<t_prediction> &prediction_nms_list, int image_width, int image_height, int input_width, int input_height)
+{
+    // Rescale the final prediction (letterboxed) back to original image
+    int letterbox_width, letterbox_height;
+    get_letterbox_shape(image_width, image_height, input_width, input_height, letterbox_width, letterbox_height);
+
+    float x_scale = float(letterbox_width) / float(input_width);
+    float y_scale = float(letterbox_height) / float(input_height);
+    int x_offset = (letterbox_width - image_width) / 2;
+    int y_offset = (letterbox_height - image_height) / 2;
 
     for(auto &prediction_nms : prediction_nms_list) {
-        prediction_nms.x = prediction_nms.x * scale - x_offset;
-        prediction_nms.y = prediction_nms.y * scale - y_offset;
-        prediction_nms.width = prediction_nms.width * scale;
-        prediction_nms.height = prediction_nms.height * scale;
+        prediction_nms.x = prediction_nms.x * x_scale - x_offset;
+        prediction_nms.y = prediction_nms.y * y_scale - y_offset;
+        prediction_nms.width = prediction_nms.width * x_scale;
+        prediction_nms.height = prediction_nms.height * y_scale;
     }
 
     return;
@@ -518,37 +610,51 @@ void adjust_boxes(std::vector<t_prediction> &prediction_nms_list, int image_widt
 
 
 //Resize image with unchanged aspect ratio using padding
-uint8_t* letterbox_image(uint8_t* inputImage, int image_width, int image_height, int image_channel)
+uint8_t* letterbox_image(uint8_t* inputImage, int image_width, int image_height, int image_channel,
+                         int input_width, int input_height, int& letterbox_width, int& letterbox_height)
 {
-    // if input image is square, just return original
-    if (image_width == image_height) {
+    get_letterbox_shape(image_width, image_height, input_width, input_height, letterbox_width, letterbox_height);
+
+    // if input image already fits model input, just return original
+    if (letterbox_width == image_width && letterbox_height == image_height) {
         return inputImage;
     }
 
-    int square_dim = std::max(image_width, image_height);
-    int x_offset, y_offset;
-
-    uint8_t* squareImage = (uint8_t*)malloc(square_dim * square_dim * image_channel * sizeof(uint8_t));
+    int x_offset = (letterbox_width - image_width) / 2;
+    int y_offset = (letterbox_height - image_height) / 2;
 
-    if ( image_width > image_height ) {
-        x_offset = 0;
-        y_offset = floor((image_width - image_height) / 2);
-    }
-    else {
-        x_offset = floor((image_height - image_width) / 2);
-        y_offset = 0;
+    uint8_t* letterboxImage = (uint8_t*)malloc(letterbox_width * letterbox_height * image_channel * sizeof(uint8_t));
+    if (letterboxImage == nullptr) {
+        MNN_PRINT("Can't alloc memory\n");
+        exit(-1);
     }
 
-    // paste input image into square image
+    // fill padding area with grey (128), same as letterbox_resize() in training
+    memset(letterboxImage, 128, letterbox_width * letterbox_height * image_channel * sizeof(uint8_t));
+
+    // paste input image into letterbox image
     for (int h = 0; h < image_height; h++) {
-        for (int w = 0; w < image_width; w++) {
-            for (int c = 0; c < image_channel; c++) {
-                squareImage[(h+y_offset)*square_dim*image_channel + (w+x_offset)*image_channel + c] = inputImage[h*image_width*image_channel + w*image_channel + c];
-            }
-        }
+        memcpy(letterboxImage + ((h + y_offset) * letterbox_width + x_offset) * image_channel,
+               inputImage + h * image_width * image_channel,
+               image_width * image_channel * sizeof(uint8_t));
     }
 
-    return squareImage;
+    return letterboxImage;
+}
+
+
+// convert resized pixels to float model input, normalized with the
+// kernel of CPU variant
+static void normalize_input(float* out, const uint8_t* in, int count, Settings* s)
+{
+    get_kernels()->normalize(in, out, count, s->input_mean, 1.0f / s->input_std);
+    return;
+}
+
+static void normalize_input(uint8_t* out, const uint8_t* in, int count, Settings* s)
+{
+    memcpy(out, in, count);
+    return;
 }
 
 
@@ -566,37 +672,390 @@ void resize(T* out, uint8_t* in, int image_width, int image_height,
                      resized, input_width, input_height, 0, input_channels);
 
   auto output_number_of_pixels = input_height * input_width * input_channels;
-
-  for (int i = 0; i < output_number_of_pixels; i++) {
-    if (s->input_floating)
-      out[i] = (resized[i] - s->input_mean) / s->input_std;
-    else
-      out[i] = (uint8_t)resized[i];
-  }
+  normalize_input(out, resized, output_number_of_pixels, s);
 
   free(resized);
   return;
 }
 
 
-void RunInference(Settings* s) {
-    // record run time for every stage
-    struct timeval start_time, stop_time;
+// letterbox & resize image with stb, then normalize into model input
+static void preprocess_image_stb(uint8_t* input_data, const t_image_buffer& image, int input_width, int input_height,
+                                 int input_channel, bool input_floating, Settings* s)
+{
+    // pad input image to letterboxed for input resize
+    int letterbox_width, letterbox_height;
+    uint8_t* letterboxImage = letterbox_image(image.data, image.width, image.height, image.channel,
+                                              input_width, input_height, letterbox_width, letterbox_height);
+
+    if (input_floating) {
+        resize<float>((float*)input_data, letterboxImage,
+            letterbox_width, letterbox_height, image.channel, input_width,
+            input_height, input_channel, s);
+    } else {
+        resize<uint8_t>(input_data, letterboxImage,
+            letterbox_width, letterbox_height, image.channel, input_width,
+            input_height, input_channel, s);
+    }
+
+    if(letterboxImage != image.data) {
+        free(letterboxImage);
+    }
+    return;
+}
+
+
+static ImageFormat get_image_format(int channel)
+{
+    if (channel == 1) {
+        return GRAY;
+    } else if (channel == 4) {
+        return RGBA;
+    }
+    return RGB;
+}
+
+
+// letterbox, resize & normalize image into model input in one pass
+// with MNN ImageProcess. The affine matrix maps model input pixel
+// back to origin image, and pixels out of image get grey (128)
+// padding, same as letterbox_image(). ImageProcess is created once
+// per (image channel, input channel, input type) for every thread, and
+// only the matrix is set per image
+static void preprocess_image_mnn(uint8_t* input_data, const t_image_buffer& image, int input_width, int input_height,
+                                 int input_channel, bool input_floating, Settings* s)
+{
+    static thread_local std::map<std::tuple<int, int, bool>, std::unique_ptr<ImageProcess>> processes;
+    auto& process = processes[std::make_tuple(image.channel, input_channel, input_floating)];
+    if (!process) {
+        ImageProcess::Config config;
+        config.filterType = BILINEAR;
+        config.sourceFormat = get_image_format(image.channel);
+        config.destFormat = get_image_format(input_channel);
+        config.wrap = ZERO;
+        if (input_floating) {
+            for (int i = 0; i < 4; i++) {
+                config.mean[i] = s->input_mean;
+                config.normal[i] = 1.0f / s->input_std;
+            }
+        }
+        process.reset(ImageProcess::create(config));
+        process->setPadding(128);
+    }
+
+    int letterbox_width, letterbox_height;
+    get_letterbox_shape(image.width, image.height, input_width, input_height, letterbox_width, letterbox_height);
+    int x_offset = (letterbox_width - image.width) / 2;
+    int y_offset = (letterbox_height - image.height) / 2;
+
+    Matrix trans;
+    trans.setScale(float(letterbox_width) / float(input_width), float(letterbox_height) / float(input_height));
+    trans.postTranslate(-x_offset, -y_offset);
+    process->setMatrix(trans);
+
+    halide_type_t type = input_floating ? halide_type_of<float>() : halide_type_of<uint8_t>();
+    process->convert(image.data, image.width, image.height, 0, input_data,
+                     input_width, input_height, input_channel, 0, type);
+    return;
+}
+
+
+void preprocess_image(Tensor* image_input, const int batch_index, const t_image_buffer& image, Settings* s)
+{
+    int input_width = image_input->width();
+    int input_height = image_input->height();
+    int input_channel = image_input->channel();
+
+    // model input is float, or uint8 for quantized model. taken from
+    // the session input, as workers may run models of both types
+    bool input_floating = (image_input->getType().code == halide_type_float);
+    int unit = input_floating ? sizeof(float) : sizeof(uint8_t);
+    uint8_t* input_data = image_input->host<uint8_t>() + batch_index * input_width * input_height * input_channel * unit;
+
+    if (s->preprocess == "mnn") {
+        preprocess_image_mnn(input_data, image, input_width, input_height, input_channel, input_floating, s);
+    } else {
+        preprocess_image_stb(input_data, image, input_width, input_height, input_channel, input_floating, s);
+    }
+    return;
+}
+
+
+bool parse_image_size(const std::string& str, int& width, int& height)
+{
+    // input size should be like "416" or "608x352"
+    size_t pos = str.find('x');
+    width = atoi(str.substr(0, pos).c_str());
+    height = (pos == std::string::npos) ? width : atoi(str.substr(pos + 1).c_str());
+
+    // YOLO feature map needs input size to be multiple of 32
+    return (width > 0 && height > 0 && width % 32 == 0 && height % 32 == 0);
+}
+
+
+void resize_session_input(Interpreter* net, Session* session, const int batch,
+                          const int input_width, const int input_height)
+{
+    auto image_input = net->getSessionInputAll(session).begin()->second;
+
+    auto shape = image_input->shape();
+    shape[0] = batch;
+    if (input_width > 0 && input_height > 0) {
+        if (image_input->getDimensionType() == Tensor::TENSORFLOW) {
+            // NHWC
+            shape[1] = input_height;
+            shape[2] = input_width;
+        } else {
+            // NCHW
+            shape[2] = input_height;
+            shape[3] = input_width;
+        }
+    }
+    net->resizeTensor(image_input, shape);
+    net->resizeSession(session);
+    return;
+}
+
+
+// parse backend mode strings (normal/high/low) to BackendConfig
+// precision/power/memory mode
+bool parse_precision_mode(const std::string& str, BackendConfig::PrecisionMode& mode)
+{
+    if (str == "normal") {
+        mode = BackendConfig::Precision_Normal;
+    } else if (str == "high") {
+        mode = BackendConfig::Precision_High;
+    } else if (str == "low") {
+        mode = BackendConfig::Precision_Low;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool parse_power_mode(const std::string& str, BackendConfig::PowerMode& mode)
+{
+    if (str == "normal") {
+        mode = BackendConfig::Power_Normal;
+    } else if (str == "high") {
+        mode = BackendConfig::Power_High;
+    } else if (str == "low") {
+        mode = BackendConfig::Power_Low;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool parse_memory_mode(const std::string& str, BackendConfig::MemoryMode& mode)
+{
+    if (str == "normal") {
+        mode = BackendConfig::Memory_Normal;
+    } else if (str == "high") {
+        mode = BackendConfig::Memory_High;
+    } else if (str == "low") {
+        mode = BackendConfig::Memory_Low;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+
+Session* create_session(Interpreter* net, Settings* s, const int batch,
+                        const int input_width, const int input_height)
+{
+    // precision low allows fp16/bf16 arithmetic on supporting CPU
+    // modes are validated at option parsing
+    BackendConfig backend_config;
+    parse_precision_mode(s->precision, backend_config.precision);
+    parse_power_mode(s->power, backend_config.power);
+    parse_memory_mode(s->memory, backend_config.memory);
 
-    // create model & session
-    std::shared_ptr<Interpreter> net(Interpreter::createFromFile(s->model_name.c_str()));
     ScheduleConfig config;
     config.type  = MNN_FORWARD_AUTO;
     config.numThread = s->number_of_threads;
+    config.backendConfig = &backend_config;
     auto session = net->createSession(config);
 
-    // get input tensor info
     // assume only 1 input tensor (image_input)
-    auto inputs = net->getSessionInputAll(session);
-    MNN_ASSERT(inputs.size() == 1);
-    auto image_input = inputs.begin()->second;
+    MNN_ASSERT(net->getSessionInputAll(session).size() == 1);
 
-    auto shape = image_input->shape();
+    int width = (input_width > 0) ? input_width : s->model_input_width;
+    int height = (input_height > 0) ? input_height : s->model_input_height;
+    resize_session_input(net, session, batch, width, height);
+    return session;
+}
+
+
+const t_cached_session& get_cached_session(Interpreter* net, Settings* s, t_session_cache& session_cache,
+                                           const int num_classes, const std::vector<std::pair<float, float>>& anchors,
+                                           const int batch, const int input_width, const int input_height)
+{
+    auto key = std::make_tuple(batch, input_width, input_height);
+    auto iter = session_cache.sessions.find(key);
+    if (iter != session_cache.sessions.end()) {
+        // move to most recently used
+        session_cache.lru_keys.splice(session_cache.lru_keys.begin(), session_cache.lru_keys, iter->second.lru_iter);
+        return iter->second;
+    }
+
+    if (session_cache.sessions.size() >= SESSION_CACHE_MAX_SIZE) {
+        // release least recently used session
+        auto& lru_key = session_cache.lru_keys.back();
+        auto lru_session = session_cache.sessions.at(lru_key).session;
+        release_host_outputs(net, lru_session);
+        net->releaseSession(lru_session);
+        session_cache.sessions.erase(lru_key);
+        session_cache.lru_keys.pop_back();
+    }
+
+    // decode plan is built with the session, as it depends on the
+    // model and the session input shape
+    auto session = create_session(net, s, batch, input_width, input_height);
+    auto plan = create_head_plan(net, session, anchors, num_classes, s->head_config_file_name);
+    session_cache.lru_keys.emplace_front(key);
+    auto& cached_session = session_cache.sessions[key];
+    cached_session = {session, plan, session_cache.lru_keys.begin()};
+    return cached_session;
+}
+
+
+// host copies of session outputs, per output tensor. A session is only
+// run by one thread at a time, so the lock only guards the map
+static std::mutex g_host_outputs_mutex;
+static std::map<const Tensor*, std::shared_ptr<Tensor>> g_host_outputs;
+
+
+// get session output on host for postprocess. float output of CPU
+// backend is decoded in place in its native layout, with no copy.
+// Otherwise the output is copied to a host tensor which is kept for
+// next runs of the session
+const Tensor* get_host_output(const Tensor* output_tensor)
+{
+    auto type = output_tensor->getType();
+    bool is_float = (type.code == halide_type_float && type.bits == 32);
+    if (is_float && output_tensor->deviceId() == 0 && output_tensor->host<float>() != nullptr) {
+        return output_tensor;
+    }
+
+    // keep the native layout (NC4HW4 for CPU backend), which is
+    // decoded directly, so the host copy needs no layout conversion
+    auto dim_type = output_tensor->getDimensionType();
+    if (!is_float) {
+        dim_type = Tensor::TENSORFLOW;
+    }
+
+    std::shared_ptr<Tensor> output_host;
+    {
+        std::lock_guard<std::mutex> lock(g_host_outputs_mutex);
+        output_host = g_host_outputs[output_tensor];
+    }
+    if (!output_host || output_host->getDimensionType() != dim_type ||
+        output_host->batch() != output_tensor->batch() || output_host->channel() != output_tensor->channel() ||
+        output_host->height() != output_tensor->height() || output_host->width() != output_tensor->width()) {
+        // new output, or session resized
+        output_host.reset(new Tensor(output_tensor, dim_type));
+        std::lock_guard<std::mutex> lock(g_host_outputs_mutex);
+        g_host_outputs[output_tensor] = output_host;
+    }
+    output_tensor->copyToHostTensor(output_host.get());
+
+    return output_host.get();
+}
+
+
+void release_host_outputs(Interpreter* net, Session* session)
+{
+    std::lock_guard<std::mutex> lock(g_host_outputs_mutex);
+    for (auto& output : net->getSessionOutputAll(session)) {
+        g_host_outputs.erase(output.second);
+    }
+    return;
+}
+
+
+void detect_batch(Interpreter* net, Session* session, const t_head_plan* plan,
+                  const std::vector<t_image_buffer>& images, const int num_classes,
+                  std::vector<std::vector<t_prediction>>& prediction_nms_lists, Settings* s)
+{
+    auto image_input = net->getSessionInputAll(session).begin()->second;
+    int input_width = image_input->width();
+    int input_height = image_input->height();
+    int batch = images.size();
+
+    // session input batch should be aligned with image number
+    MNN_ASSERT(image_input->batch() == batch);
+
+    for (int b = 0; b < batch; b++) {
+        preprocess_image(image_input, b, images[b], s);
+    }
+
+    prediction_nms_lists.resize(batch);
+    if (net->runSession(session) != NO_ERROR) {
+        MNN_PRINT("Failed to invoke MNN!\n");
+        return;
+    }
+
+    // plan layers are indexed in session output order. the check is
+    // cheap compared to session run, and kept in release build
+    if (!match_head_plan(net, session, *plan)) {
+        exit(-1);
+    }
+
+    // Get output tensors on host and parse out valid predictions
+    std::vector<std::vector<t_prediction>> prediction_lists(batch);
+    auto outputs = net->getSessionOutputAll(session);
+    int layer_index = 0;
+    for(auto output : outputs) {
+        const t_head_layer& layer = plan->layers[layer_index++];
+        const Tensor* output_host = get_host_output(output.second);
+
+        for (int b = 0; b < batch; b++) {
+            yolo_postprocess(output_host, b, layer, num_classes, prediction_lists[b], s->conf_threshold);
+        }
+    }
+
+    // Do NMS for predictions, and rescale back to original image
+    for (int b = 0; b < batch; b++) {
+        nms_boxes(prediction_lists[b], prediction_nms_lists[b], num_classes, s->iou_threshold);
+        adjust_boxes(prediction_nms_lists[b], images[b].width, images[b].height, input_width, input_height);
+    }
+
+    return;
+}
+
+
+void detect_image(Interpreter* net, Session* session, const t_head_plan* plan,
+                  uint8_t* inputImage, int image_width, int image_height, int image_channel,
+                  const int num_classes, std::vector<t_prediction>& prediction_nms_list, Settings* s)
+{
+    t_image_buffer image;
+    image.data = inputImage;
+    image.width = image_width;
+    image.height = image_height;
+    image.channel = image_channel;
+
+    std::vector<std::vector<t_prediction>> prediction_nms_lists;
+    detect_batch(net, session, plan, std::vector<t_image_buffer>(1, image), num_classes, prediction_nms_lists, s);
+
+    prediction_nms_list.insert(prediction_nms_list.end(), prediction_nms_lists[0].begin(), prediction_nms_lists[0].end());
+    return;
+}
+
+
+void RunInference(Settings* s) {
+    // record run time for every stage
+    struct timeval start_time, stop_time;
+
+    // create model & session
+    std::shared_ptr<Interpreter> net(Interpreter::createFromFile(s->model_name.c_str()));
+    auto session = create_session(net.get(), s);
+    MNN_PRINT("backend config: threads %d, precision %s, power %s, memory %s\n", s->number_of_threads,
+              s->precision.c_str(), s->power.c_str(), s->memory.c_str());
+
+    // get input tensor info
+    auto image_input = net->getSessionInputAll(session).begin()->second;
     int input_width = image_input->width();
     int input_height = image_input->height();
     int input_channel = image_input->channel();
@@ -607,12 +1066,6 @@ void RunInference(Settings* s) {
     if (input_width == 0)
         input_width = 1;
     MNN_PRINT("image_input: width:%d , height:%d, channel: %d\n", input_width, input_height, input_channel);
-    // assume the model input is square
-    MNN_ASSERT(input_width == input_height);
-
-    shape[0] = 1;
-    net->resizeTensor(image_input, shape);
-    net->resizeSession(session);
 
     // get output tensor info (e.g. for YOLOv3 arch):
     //image_input: 1 x 416 x 416 x 3
@@ -622,28 +1075,16 @@ void RunInference(Settings* s) {
     auto outputs = net->getSessionOutputAll(session);
     int num_layers = outputs.size();
 
-    // get classes labels
+    // get classes labels & anchor value
     std::vector<std::string> classes;
-    std::ifstream classesOs(s->classes_file_name.c_str());
-    std::string line;
-    while (std::getline(classesOs, line)) {
-        classes.emplace_back(line);
-    }
+    std::vector<std::pair<float, float>> anchors;
+    load_classes_anchors(s, classes, anchors);
     int num_classes = classes.size();
     MNN_PRINT("num_classes: %d\n", num_classes);
 
-    // get anchor value
-    std::vector<std::pair<float, float>> anchors;
-    std::ifstream anchorsOs(s->anchors_file_name.c_str());
-    while (std::getline(anchorsOs, line)) {
-        parse_anchors(line, anchors);
-    }
-
-    // For YOLOv3 model, we should have 9 anchors and 3 feature layers
-    // For Tiny YOLOv3 model, we should have 6 anchors and 2 feature layers
-    // For YOLOv2 model, we should have 5 anchors and 1 feature layers
-    if(num_layers > 1)
-        MNN_ASSERT(anchors.size() / num_layers == 3);
+    // anchors of each feature layer are picked by head config, see
+    // yoloHead.h. default is 9 anchors for 3 layers of YOLOv3, 6 for
+    // 2 layers of Tiny YOLOv3 and 5 for 1 layer of YOLOv2
 
     // load input image
     auto inputPath = s->input_img_name.c_str();
@@ -654,32 +1095,38 @@ void RunInference(Settings* s) {
         return;
     }
 
-    // pad input image to letterboxed for input resize
-    uint8_t* letterboxImage = letterbox_image(inputImage, image_width, image_height, image_channel);
-    int square_dim = std::max(image_width, image_height);
+    // use minimal rectangular model input for the image shape
+    if (s->rect_input) {
+        get_rect_input_shape(image_width, image_height, input_width, input_height, input_width, input_height);
+        resize_session_input(net.get(), session, 1, input_width, input_height);
+        MNN_PRINT("rectangular image_input: width:%d , height:%d\n", input_width, input_height);
+    }
 
-    std::vector<uint8_t> in(letterboxImage, letterboxImage + square_dim * square_dim * image_channel * sizeof(uint8_t));
+    MNN_PRINT("origin image size: width:%d, height:%d, channel:%d\n", image_width, image_height, image_channel);
+
+    t_image_buffer image = {inputImage, image_width, image_height, image_channel};
+
+    // benchmark image preprocess (letterbox, resize & normalize)
+    gettimeofday(&start_time, nullptr);
+    for (int i = 0; i < s->loop_count; i++) {
+        preprocess_image(image_input, 0, image, s);
+    }
+    gettimeofday(&stop_time, nullptr);
+    MNN_PRINT("image preprocess (%s) average time: %lf ms\n", s->preprocess.c_str(), (get_us(stop_time) - get_us(start_time)) / (1000 * s->loop_count));
 
     // free input image
     stbi_image_free(inputImage);
-    if(letterboxImage != inputImage) {
-        free(letterboxImage);
-    }
     inputImage = nullptr;
-    letterboxImage = nullptr;
-
-    MNN_PRINT("origin image size: width:%d, height:%d, channel:%d\n", image_width, image_height, image_channel);
 
-    // assume input tensor type is float
-    MNN_ASSERT(image_input->getType().code == halide_type_float);
-    s->input_floating = true;
+    // build decode plan of output layers, before any timing
+    auto plan = create_head_plan(net.get(), session, anchors, num_classes, s->head_config_file_name);
+    if (!match_head_plan(net.get(), session, *plan)) {
+        exit(-1);
+    }
 
     // run warm up session
     if (s->loop_count > 1)
         for (int i = 0; i < s->number_of_warmup_runs; i++) {
-            resize<float>(image_input->host<float>(), in.data(),
-                square_dim, square_dim, image_channel, input_width,
-                input_height, input_channel, s);
             if (net->runSession(session) != NO_ERROR) {
                 MNN_PRINT("Failed to invoke MNN!\n");
             }
@@ -688,9 +1135,6 @@ void RunInference(Settings* s) {
     // run model sessions to get output
     gettimeofday(&start_time, nullptr);
     for (int i = 0; i < s->loop_count; i++) {
-        resize<float>(image_input->host<float>(), in.data(),
-            square_dim, square_dim, image_channel, input_width,
-            input_height, input_channel, s);
         if (net->runSession(session) != NO_ERROR) {
             MNN_PRINT("Failed to invoke MNN!\n");
         }
@@ -699,35 +1143,37 @@ void RunInference(Settings* s) {
     MNN_PRINT("model invoke average time: %lf ms\n", (get_us(stop_time) - get_us(start_time)) / (1000 * s->loop_count));
 
 
-    // Copy output tensors to host, for further postprocess
-    std::vector<std::shared_ptr<Tensor>> featureTensors;
+    // Get output tensors on host, for further postprocess
+    std::vector<const Tensor*> featureTensors;
     for(auto output : outputs) {
         MNN_PRINT("output tensor name: %s\n", output.first.c_str());
-        auto output_tensor = output.second;
-        auto dim_type = output_tensor->getDimensionType();
-        if (output_tensor->getType().code != halide_type_float) {
-            dim_type = Tensor::TENSORFLOW;
+        const Tensor* output_host = get_host_output(output.second);
+        auto dim_type = output_host->getDimensionType();
+        if (dim_type == Tensor::TENSORFLOW) {
+            MNN_PRINT("Tensorflow format: NHWC\n");
+        } else if (dim_type == Tensor::CAFFE) {
+            MNN_PRINT("Caffe format: NCHW\n");
+        } else if (dim_type == Tensor::CAFFE_C4) {
+            MNN_PRINT("Caffe format: NC4HW4\n");
         }
-        std::shared_ptr<Tensor> output_user(new Tensor(output_tensor, dim_type));
-        output_tensor->copyToHostTensor(output_user.get());
-        featureTensors.emplace_back(output_user);
+        MNN_PRINT("Output on host: %s\n", (output_host == output.second) ? "in place" : "copied");
+        featureTensors.emplace_back(output_host);
     }
 
     // Do yolo_postprocess to parse out valid predictions
     std::vector<t_prediction> prediction_list;
-    float conf_threshold = 0.1;
-    float iou_threshold = 0.4;
+    float conf_threshold = s->conf_threshold;
+    float iou_threshold = s->iou_threshold;
 
     gettimeofday(&start_time, nullptr);
 
     for (int i = 0; i < num_layers; ++i) {
-        Tensor* feature_map = featureTensors[i].get();
-        std::vector<std::pair<float, float>> anchorset = get_anchorset(anchors, feature_map->width(), input_width);
+        const Tensor* feature_map = featureTensors[i];
 
         // Now we only support float32 type output tensor
         MNN_ASSERT(featureTensors[i]->getType().code == halide_type_float);
         MNN_ASSERT(featureTensors[i]->getType().bits == 32);
-        yolo_postprocess(featureTensors[i].get(), input_width, input_height, num_classes, anchorset, prediction_list, conf_threshold);
+        yolo_postprocess(feature_map, 0, plan->layers[i], num_classes, prediction_list, conf_threshold);
     }
 
     gettimeofday(&stop_time, nullptr);
@@ -735,6 +1181,7 @@ void RunInference(Settings* s) {
 
     // Do NMS for predictions
     std::vector<t_prediction> prediction_nms_list;
+    MNN_PRINT("prediction_list size before NMS: %lu\n", prediction_list.size());
     gettimeofday(&start_time, nullptr);
     nms_boxes(prediction_list, prediction_nms_list, num_classes, iou_threshold);
     gettimeofday(&stop_time, nullptr);
@@ -749,6 +1196,15 @@ void RunInference(Settings* s) {
         MNN_PRINT("%s %f (%d, %d) (%d, %d)\n", classes[prediction_nms.class_index].c_str(), prediction_nms.confidence, int(prediction_nms.x), int(prediction_nms.y), int(prediction_nms.x + prediction_nms.width), int(prediction_nms.y + prediction_nms.height));
     }
 
+    // Save structured detection result
+    std::unique_ptr<ResultWriter> result_writer;
+    FILE* result_file = nullptr;
+    if (!s->result_file_name.empty() &&
+        open_result_writer(s->result_file_name, s->result_format, classes, result_writer, result_file)) {
+        result_writer->write(s->input_img_name, 0, image_width, image_height, prediction_nms_list);
+        close_result_writer(result_writer, result_file);
+    }
+
     return;
 }
 
@@ -757,10 +1213,14 @@ int main(int argc, char** argv) {
   Settings s;
 
   int c;
+  BackendConfig backend_config;  // only to validate mode options
   while (1) {
     static struct option long_options[] = {
         {"mnn_model", required_argument, nullptr, 'm'},
         {"image", required_argument, nullptr, 'i'},
+        {"image_dir", required_argument, nullptr, 'd'},
+        {"result_file", required_argument, nullptr, 'o'},
+        {"result_format", required_argument, nullptr, 'g'},
         {"classes", required_argument, nullptr, 'l'},
         {"anchors", required_argument, nullptr, 'a'},
         {"input_mean", required_argument, nullptr, 'b'},
@@ -768,6 +1228,33 @@ int main(int argc, char** argv) {
         {"threads", required_argument, nullptr, 't'},
         {"count", required_argument, nullptr, 'c'},
         {"warmup_runs", required_argument, nullptr, 'w'},
+        {"conf_threshold", required_argument, nullptr, 'r'},
+        {"iou_threshold", required_argument, nullptr, 'u'},
+        {"annotation_file", required_argument, nullptr, 'e'},
+        {"eval_type", required_argument, nullptr, 'y'},
+        {"eval_iou_threshold", required_argument, nullptr, 'p'},
+        {"workers", required_argument, nullptr, 'j'},
+        {"server", required_argument, nullptr, 'x'},
+        {"max_batch", required_argument, nullptr, 'n'},
+        {"batch_timeout", required_argument, nullptr, 'z'},
+        {"shm_ring", required_argument, nullptr, 'k'},
+        {"model_image_size", required_argument, nullptr, 'q'},
+        {"rect_input", required_argument, nullptr, 'R'},
+        {"tiled", required_argument, nullptr, 'T'},
+        {"tile_overlap", required_argument, nullptr, 'O'},
+        {"tta", required_argument, nullptr, 'A'},
+        {"tta_merge", required_argument, nullptr, 'M'},
+        {"track", required_argument, nullptr, 'K'},
+        {"skip_frames", required_argument, nullptr, 'S'},
+        {"motion_gate", required_argument, nullptr, 'G'},
+        {"video", required_argument, nullptr, 'V'},
+        {"video_format", required_argument, nullptr, 'F'},
+        {"cpu_kernel", required_argument, nullptr, 'X'},
+        {"head_config", required_argument, nullptr, 'H'},
+        {"preprocess", required_argument, nullptr, 'P'},
+        {"precision", required_argument, nullptr, 'C'},
+        {"power", required_argument, nullptr, 'W'},
+        {"memory", required_argument, nullptr, 'E'},
         //{"verbose", required_argument, nullptr, 'v'},
         {"help", no_argument, nullptr, 'h'},
         {nullptr, 0, nullptr, 0}};
@@ -776,7 +1263,7 @@ int main(int argc, char** argv) {
     int option_index = 0;
 
     c = getopt_long(argc, argv,
-                    "a:b:c:hi:l:m:s:t:w:", long_options,
+                    "a:A:b:c:C:d:e:E:F:g:G:hH:i:j:k:K:l:m:M:n:o:O:p:P:q:r:R:s:S:t:T:u:V:w:W:x:X:y:z:", long_options,
                     &option_index);
 
     /* Detect the end of the options. */
@@ -786,6 +1273,12 @@ int main(int argc, char** argv) {
       case 'a':
         s.anchors_file_name = optarg;
         break;
+      case 'A':
+        if (!parse_tta(optarg, &s)) {
+          MNN_ERROR("Invalid TTA variants %s\n", optarg);
+          exit(-1);
+        }
+        break;
       case 'b':
         s.input_mean = strtod(optarg, nullptr);
         break;
@@ -793,30 +1286,147 @@ int main(int argc, char** argv) {
         s.loop_count =
             strtol(optarg, nullptr, 10);  // NOLINT(runtime/deprecated_fn)
         break;
+      case 'C':
+        s.precision = optarg;
+        if (!parse_precision_mode(s.precision, backend_config.precision)) {
+          MNN_ERROR("Invalid precision mode %s, should be normal, high or low\n", optarg);
+          exit(-1);
+        }
+        break;
+      case 'd':
+        s.image_dir = optarg;
+        break;
+      case 'e':
+        s.annotation_file_name = optarg;
+        break;
+      case 'E':
+        s.memory = optarg;
+        if (!parse_memory_mode(s.memory, backend_config.memory)) {
+          MNN_ERROR("Invalid memory mode %s, should be normal, high or low\n", optarg);
+          exit(-1);
+        }
+        break;
+      case 'F':
+        s.video_format = optarg;
+        break;
+      case 'g':
+        s.result_format = optarg;
+        break;
+      case 'G':
+        s.motion_gate =
+            strtol(optarg, nullptr, 10);  // NOLINT(runtime/deprecated_fn)
+        break;
+      case 'H':
+        s.head_config_file_name = optarg;
+        break;
       case 'i':
         s.input_img_name = optarg;
         break;
+      case 'j':
+        s.number_of_workers =
+            strtol(optarg, nullptr, 10);  // NOLINT(runtime/deprecated_fn)
+        break;
+      case 'k':
+        s.shm_name = optarg;
+        break;
+      case 'K':
+        s.track =
+            strtol(optarg, nullptr, 10);  // NOLINT(runtime/deprecated_fn)
+        break;
       case 'l':
         s.classes_file_name = optarg;
         break;
       case 'm':
         s.model_name = optarg;
         break;
+      case 'M':
+        s.tta_merge = optarg;
+        break;
+      case 'n':
+        s.max_batch_size =
+            strtol(optarg, nullptr, 10);  // NOLINT(runtime/deprecated_fn)
+        break;
+      case 'o':
+        s.result_file_name = optarg;
+        break;
+      case 'O':
+        s.tile_overlap = strtod(optarg, nullptr);
+        break;
+      case 'p':
+        s.eval_iou_threshold = strtod(optarg, nullptr);
+        break;
+      case 'P':
+        s.preprocess = optarg;
+        if (s.preprocess != "stb" && s.preprocess != "mnn") {
+          MNN_ERROR("Invalid preprocess %s, should be stb or mnn\n", optarg);
+          exit(-1);
+        }
+        break;
+      case 'q':
+        if (!parse_image_size(optarg, s.model_input_width, s.model_input_height)) {
+          MNN_ERROR("Invalid model image size %s, should be multiple of 32\n", optarg);
+          exit(-1);
+        }
+        break;
+      case 'R':
+        s.rect_input =
+            strtol(optarg, nullptr, 10);  // NOLINT(runtime/deprecated_fn)
+        break;
+      case 'r':
+        s.conf_threshold = strtod(optarg, nullptr);
+        break;
       case 's':
         s.input_std = strtod(optarg, nullptr);
         break;
+      case 'S':
+        s.skip_frames =
+            strtol(optarg, nullptr, 10);  // NOLINT(runtime/deprecated_fn)
+        break;
       case 't':
         s.number_of_threads = strtol(  // NOLINT(runtime/deprecated_fn)
             optarg, nullptr, 10);
         break;
+      case 'T':
+        s.tiled =
+            strtol(optarg, nullptr, 10);  // NOLINT(runtime/deprecated_fn)
+        break;
+      case 'u':
+        s.iou_threshold = strtod(optarg, nullptr);
+        break;
       //case 'v':
         //s.verbose =
             //strtol(optarg, nullptr, 10);  // NOLINT(runtime/deprecated_fn)
         //break;
+      case 'V':
+        s.video_name = optarg;
+        break;
       case 'w':
         s.number_of_warmup_runs =
             strtol(optarg, nullptr, 10);  // NOLINT(runtime/deprecated_fn)
         break;
+      case 'W':
+        s.power = optarg;
+        if (!parse_power_mode(s.power, backend_config.power)) {
+          MNN_ERROR("Invalid power mode %s, should be normal, high or low\n", optarg);
+          exit(-1);
+        }
+        break;
+      case 'x':
+        s.server_address = optarg;
+        break;
+      case 'X':
+        if (!set_kernel_variant(optarg)) {
+          MNN_ERROR("CPU kernel variant %s is not supported\n", optarg);
+          exit(-1);
+        }
+        break;
+      case 'y':
+        s.eval_type = optarg;
+        break;
+      case 'z':
+        s.batch_timeout_ms =
+            strtol(optarg, nullptr, 10);  // NOLINT(runtime/deprecated_fn)
+        break;
       case 'h':
       case '?':
       default:
@@ -825,7 +1435,23 @@ int main(int argc, char** argv) {
         exit(-1);
     }
   }
-  RunInference(&s);
+  MNN_PRINT("cpu kernel: %s\n", get_kernels()->name);
+
+  if (!s.server_address.empty()) {
+    RunServer(&s);
+  } else if (!s.shm_name.empty()) {
+    RunShmDetection(&s);
+  } else if (!s.video_name.empty()) {
+    RunVideoDetection(&s);
+  } else if (!s.annotation_file_name.empty()) {
+    RunEvaluation(&s);
+  } else if (is_batch_input(s.input_img_name)) {
+    RunBatchInference(&s);
+  } else if (s.tiled || s.tta_flip || !s.tta_sizes.empty()) {
+    RunWorkerInference(&s);
+  } else {
+    RunInference(&s);
+  }
   return 0;
 }
 
@@ -0,0 +1,238 @@
+//
+//  yoloDetection.h
+//  MNN
+//
+//  Created by Xiaobin Zhang on 2019/09/20.
+//
+//
+
+#ifndef YOLO_DETECTION_YOLO_DETECTION_H_
+#define YOLO_DETECTION_YOLO_DETECTION_H_
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <functional>
+#include <list>
+#include <map>
+#include <tuple>
+#include "MNN/Interpreter.hpp"
+#include "yoloPrediction.h"
+
+
+
+// definition of a decoded input image, HWC layout
+typedef struct image_buffer {
+    uint8_t* data;
+    int width;
+    int height;
+    int channel;
+}t_image_buffer;
+
+
+// rectangle region in origin image
+typedef struct image_rect {
+    int x;
+    int y;
+    int width;
+    int height;
+}t_image_rect;
+
+
+// model inference settings
+struct Settings {
+  int loop_count = 1;
+  int number_of_threads = 4;
+  int number_of_warmup_runs = 2;
+  int number_of_workers = 1;
+  float input_mean = 0.0f;
+  float input_std = 255.0f;
+  float conf_threshold = 0.1f;
+  float iou_threshold = 0.4f;
+  std::string model_name = "./model.mnn";
+  std::string input_img_name = "./dog.jpg";
+  std::string image_dir = "";
+  std::string result_file_name = "";
+  std::string result_format = "text";
+  std::string classes_file_name = "./classes.txt";
+  std::string anchors_file_name = "./yolo3_anchors.txt";
+  std::string head_config_file_name = "";   // "" for default anchor split
+  std::string annotation_file_name = "";
+  std::string eval_type = "VOC";
+  float eval_iou_threshold = 0.5f;
+  std::string server_address = "";
+  int max_batch_size = 4;
+  int batch_timeout_ms = 5;
+  std::string shm_name = "";
+  int model_input_width = 0;   // 0 for the model default input shape
+  int model_input_height = 0;
+  bool rect_input = false;
+  bool tiled = false;
+  float tile_overlap = 0.2f;
+  bool tta_flip = false;
+  std::vector<std::pair<int, int>> tta_sizes;
+  std::string tta_merge = "wbf";
+  float wbf_iou_threshold = 0.55f;
+  bool track = false;
+  int skip_frames = 0;
+  bool motion_gate = false;
+  std::string video_name = "";
+  std::string video_format = "";
+  std::string preprocess = "stb";
+  std::string precision = "normal";   // BackendConfig modes: normal/high/low
+  std::string power = "normal";
+  std::string memory = "normal";
+  //bool verbose = false;
+  //string input_layer_type = "uint8_t";
+};
+
+
+double get_us(struct timeval t);
+
+void parse_anchors(std::string line, std::vector<std::pair<float, float>>& anchors);
+
+// load classes labels & anchor values of Settings files
+void load_classes_anchors(Settings* s, std::vector<std::string>& classes,
+                          std::vector<std::pair<float, float>>& anchors);
+
+// parse model input size string like "416" or "608x352"
+bool parse_image_size(const std::string& str, int& width, int& height);
+
+// parse backend mode strings (normal/high/low) of BackendConfig
+bool parse_precision_mode(const std::string& str, MNN::BackendConfig::PrecisionMode& mode);
+bool parse_power_mode(const std::string& str, MNN::BackendConfig::PowerMode& mode);
+bool parse_memory_mode(const std::string& str, MNN::BackendConfig::MemoryMode& mode);
+
+// create model session with input batch resized. input width/height
+// 0 means Settings::model_input_width/height, or the model default
+MNN::Session* create_session(MNN::Interpreter* net, Settings* s, const int batch = 1,
+                             const int input_width = 0, const int input_height = 0);
+
+// resize session input to batch & input size (0 for unchanged)
+void resize_session_input(MNN::Interpreter* net, MNN::Session* session, const int batch,
+                          const int input_width = 0, const int input_height = 0);
+
+// get minimal model input shape of stride 32 multiple to fit in the
+// image with unchanged aspect ratio, within max input width/height
+void get_rect_input_shape(int image_width, int image_height, int max_input_width, int max_input_height,
+                          int& input_width, int& input_height);
+
+// decode plan of YOLO head output layers, see yoloHead.h
+struct head_plan;
+
+// sessions cached by input shape (batch, width, height), so input
+// tensor resize & memory re-planning only happens for a new shape.
+// Over SESSION_CACHE_MAX_SIZE shapes, the least recently used session
+// is released with its host outputs
+#define SESSION_CACHE_MAX_SIZE 8
+typedef std::tuple<int, int, int> t_session_key;
+typedef struct cached_session {
+    MNN::Session* session;
+    std::shared_ptr<const struct head_plan> plan;   // built at session creation
+    std::list<t_session_key>::iterator lru_iter;
+}t_cached_session;
+typedef struct session_cache {
+    std::map<t_session_key, t_cached_session> sessions;
+    std::list<t_session_key> lru_keys;  // most recently used first
+}t_session_cache;
+const t_cached_session& get_cached_session(MNN::Interpreter* net, Settings* s, t_session_cache& session_cache,
+                                           const int num_classes, const std::vector<std::pair<float, float>>& anchors,
+                                           const int batch, const int input_width = 0, const int input_height = 0);
+
+// model interpreter and its cached sessions for an inference worker
+typedef struct detect_worker {
+    std::shared_ptr<MNN::Interpreter> net;
+    t_session_cache session_cache;
+}t_detect_worker;
+
+// IoU of 2 prediction boxes
+float get_iou(t_prediction pred1, t_prediction pred2);
+
+// per-class NMS on prediction list
+void nms_boxes(const std::vector<t_prediction> prediction_list, std::vector<t_prediction>& prediction_nms_list, int num_classes, float iou_threshold);
+
+// get session output on host for postprocess, in place for CPU
+// backend, or copied to a host tensor kept across runs
+const MNN::Tensor* get_host_output(const MNN::Tensor* output_tensor);
+
+// release host output copies of session, before the session release
+void release_host_outputs(MNN::Interpreter* net, MNN::Session* session);
+
+// letterbox, resize & normalize image into model input tensor of
+// batch index, with stb or MNN ImageProcess (Settings::preprocess)
+void preprocess_image(MNN::Tensor* image_input, const int batch_index, const t_image_buffer& image, Settings* s);
+
+// detect objects on a batch of decoded images, and get the NMS
+// result of every image rescaled back to the origin image. plan is
+// the decode plan of session outputs
+void detect_batch(MNN::Interpreter* net, MNN::Session* session, const struct head_plan* plan,
+                  const std::vector<t_image_buffer>& images, const int num_classes,
+                  std::vector<std::vector<t_prediction>>& prediction_nms_lists, Settings* s);
+
+// detect objects on one decoded image, and get the NMS result
+// rescaled back to the origin image
+void detect_image(MNN::Interpreter* net, MNN::Session* session, const struct head_plan* plan,
+                  uint8_t* inputImage, int image_width, int image_height, int image_channel,
+                  const int num_classes, std::vector<t_prediction>& prediction_nms_list, Settings* s);
+
+// copy out a rectangle region of image into data
+t_image_buffer crop_image(const t_image_buffer& image, const t_image_rect& rect, std::vector<uint8_t>& data);
+
+// detect objects on large image with overlapping model-sized tiles.
+// tiles are run in batches spread over the worker sessions, and boxes
+// are merged across tiles with NMS in origin image coordinate
+void detect_image_tiled(const std::vector<t_detect_worker*>& workers, const t_image_buffer& image,
+                        const int num_classes, const std::vector<std::pair<float, float>>& anchors,
+                        std::vector<t_prediction>& prediction_nms_list, Settings* s);
+
+// parse TTA variants like "flip,320,608x352" into Settings
+bool parse_tta(const std::string& str, Settings* s);
+
+// merge predictions of several variants with weighted box fusion
+void weighted_box_fusion(const std::vector<std::vector<t_prediction>>& prediction_lists, const int num_classes,
+                         const float iou_threshold, std::vector<t_prediction>& prediction_fused_list);
+
+// detect objects with test-time augmentation: origin & flip image
+// run as one batch for model default input size and every TTA
+// size, and all the variant predictions are merged with WBF/NMS
+void detect_image_tta(t_detect_worker* worker, const t_image_buffer& image,
+                      const int num_classes, const std::vector<std::pair<float, float>>& anchors,
+                      std::vector<t_prediction>& prediction_nms_list, Settings* s);
+
+// detect objects on one decoded image with workers, in the enabled
+// mode (TTA, tiled or rectangular/default input)
+void detect_image_workers(const std::vector<t_detect_worker*>& workers, const t_image_buffer& image,
+                          const int num_classes, const std::vector<std::pair<float, float>>& anchors,
+                          std::vector<t_prediction>& prediction_nms_list, Settings* s);
+
+// callback for every finished image in detect_image_list(), called
+// under result lock with the image index and NMS result of the image.
+// image width/height is 0 if the image can't be loaded
+typedef std::function<void(int image_index, int image_width, int image_height,
+                           std::vector<t_prediction>& prediction_nms_list)> t_detect_callback;
+
+// check if input is image directory, glob pattern or image list file
+bool is_batch_input(const std::string& input_name);
+
+// do detection on image list with parallel worker sessions,
+// return worker number or -1 when fail
+int detect_image_list(const std::vector<std::string>& image_names, const int num_classes,
+                      const std::vector<std::pair<float, float>>& anchors,
+                      const t_detect_callback& callback, Settings* s);
+
+// detect on all the images of input directory/glob/list and
+// stream the results into one output file
+void RunBatchInference(Settings* s);
+
+// evaluate model mAP on annotation dataset, aligned with eval.py
+void RunEvaluation(Settings* s);
+
+// detection on one image with worker sessions, for tiled/TTA mode
+void RunWorkerInference(Settings* s);
+
+// detect every frame of Y4M/raw video file in order, and report
+// sustained fps & per-frame latency
+void RunVideoDetection(Settings* s);
+
+#endif  // YOLO_DETECTION_YOLO_DETECTION_H_
@@ -0,0 +1,417 @@
+//
+//  yoloEval.cpp
+//  MNN
+//
+//  Evaluate YOLO model mAP on annotation dataset, which
+//  is aligned with the PascalVOC/MSCOCO metrics in eval.py
+//
+
+#include <stdio.h>
+#include <math.h>
+#include <sys/time.h>
+#include <algorithm>
+#include <fstream>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "MNN/Interpreter.hpp"
+
+#include "yoloDetection.h"
+
+using namespace MNN;
+
+
+// definition of a ground truth/prediction box record,
+// box coordinate is (xmin,ymin,xmax,ymax) format
+typedef struct box_record {
+    int image_index;
+    double xmin;
+    double ymin;
+    double xmax;
+    double ymax;
+    double score;
+}t_box_record;
+
+// box records of every class
+typedef std::vector<std::vector<t_box_record>> t_class_records;
+
+
+// parse annotation lines to get image list and ground truth class records
+//
+// annotation line would be like:
+// path/to/img1.jpg 50,100,150,200,0 30,50,200,120,3
+void annotation_parse(const std::vector<std::string>& annotation_lines, const int num_classes,
+                      std::vector<std::string>& image_names, t_class_records& gt_classes_records)
+{
+    gt_classes_records.clear();
+    gt_classes_records.resize(num_classes);
+
+    for (auto& line : annotation_lines) {
+        std::istringstream line_stream(line);
+        std::string image_name, box;
+
+        if (!(line_stream >> image_name)) {
+            continue;
+        }
+        int image_index = image_names.size();
+        image_names.emplace_back(image_name);
+
+        while (line_stream >> box) {
+            t_box_record gt_record;
+            int class_index = -1;
+            if (sscanf(box.c_str(), "%lf,%lf,%lf,%lf,%d", &gt_record.xmin, &gt_record.ymin,
+                       &gt_record.xmax, &gt_record.ymax, &class_index) != 5 ||
+                class_index < 0 || class_index >= num_classes) {
+                MNN_PRINT("invalid box %s in annotation of %s\n", box.c_str(), image_name.c_str());
+                continue;
+            }
+            gt_record.image_index = image_index;
+            gt_record.score = 0.0;
+            gt_classes_records[class_index].emplace_back(gt_record);
+        }
+    }
+
+    return;
+}
+
+
+// calculate iou for predict box and ground truth box
+double box_iou(const t_box_record& pred_box, const t_box_record& gt_box)
+{
+    double inter_xmin = std::max(pred_box.xmin, gt_box.xmin);
+    double inter_ymin = std::max(pred_box.ymin, gt_box.ymin);
+    double inter_xmax = std::min(pred_box.xmax, gt_box.xmax);
+    double inter_ymax = std::min(pred_box.ymax, gt_box.ymax);
+
+    // compute overlap (IoU) = area of intersection / area of union
+    double pred_area = (pred_box.xmax - pred_box.xmin) * (pred_box.ymax - pred_box.ymin);
+    double gt_area = (gt_box.xmax - gt_box.xmin) * (gt_box.ymax - gt_box.ymin);
+    double inter_area = (inter_xmax - inter_xmin) * (inter_ymax - inter_ymin);
+    double union_area = pred_area + gt_area - inter_area;
+
+    return union_area == 0 ? 0 : inter_area / union_area;
+}
+
+
+// VOC2012 AP: area under the monotonically decreasing precision/recall curve
+double voc_ap(const std::vector<double>& rec, const std::vector<double>& prec)
+{
+    std::vector<double> mrec, mpre;
+
+    mrec.emplace_back(0.0);
+    mrec.insert(mrec.end(), rec.begin(), rec.end());
+    mrec.emplace_back(1.0);
+
+    mpre.emplace_back(0.0);
+    mpre.insert(mpre.end(), prec.begin(), prec.end());
+    mpre.emplace_back(0.0);
+
+    // make the precision monotonically decreasing
+    for (int i = int(mpre.size()) - 2; i >= 0; i--) {
+        mpre[i] = std::max(mpre[i], mpre[i + 1]);
+    }
+
+    // sum up the area where the recall changes
+    double ap = 0.0;
+    for (size_t i = 1; i < mrec.size(); i++) {
+        if (mrec[i] != mrec[i - 1]) {
+            ap += (mrec[i] - mrec[i - 1]) * mpre[i];
+        }
+    }
+
+    return ap;
+}
+
+
+// calculate AP value for one class records, pred_records should
+// be sorted with descending score
+double calc_AP(const std::vector<t_box_record>& gt_records, const std::vector<t_box_record>& pred_records,
+               const int num_images, double iou_threshold, int& true_positive_count)
+{
+    // group gt records by image, and mark usage flag for matching gt search
+    std::vector<std::vector<int>> image_gt_indexes(num_images);
+    for (size_t i = 0; i < gt_records.size(); i++) {
+        image_gt_indexes[gt_records[i].image_index].emplace_back(i);
+    }
+    std::vector<bool> gt_used(gt_records.size(), false);
+
+    std::vector<double> rec, prec;
+    int true_positive = 0;
+    int false_positive = 0;
+    true_positive_count = 0;
+
+    // assign predictions to ground truth objects
+    for (auto& pred_record : pred_records) {
+        double max_iou = 0.0;
+        int max_index = -1;
+
+        // if the ground truth has been assigned to other
+        // prediction, we couldn't reuse it
+        for (auto gt_index : image_gt_indexes[pred_record.image_index]) {
+            double iou = box_iou(pred_record, gt_records[gt_index]);
+            if (iou > max_iou && !gt_used[gt_index]) {
+                max_iou = iou;
+                max_index = gt_index;
+            }
+        }
+
+        // drop the prediction if couldn't match iou threshold
+        if (max_index != -1 && max_iou >= iou_threshold) {
+            gt_used[max_index] = true;
+            true_positive++;
+            true_positive_count++;
+        } else {
+            false_positive++;
+        }
+
+        // compute precision/recall
+        rec.emplace_back(gt_records.empty() ? 0.0 : double(true_positive) / gt_records.size());
+        prec.emplace_back(double(true_positive) / (true_positive + false_positive));
+    }
+
+    return voc_ap(rec, prec);
+}
+
+
+// compute PascalVOC style mAP percentage value, also get
+// AP/precision/recall of every class
+double compute_mAP_PascalVOC(const t_class_records& gt_classes_records, const t_class_records& pred_classes_records,
+                             const int num_images, double iou_threshold, std::vector<double>& APs,
+                             double& mPrec, double& mRec, std::vector<double>& precisions, std::vector<double>& recalls)
+{
+    int num_classes = gt_classes_records.size();
+    APs.assign(num_classes, 0.0);
+    precisions.assign(num_classes, 0.0);
+    recalls.assign(num_classes, 0.0);
+
+    for (int i = 0; i < num_classes; i++) {
+        // if there's no gt obj or we didn't detect any obj for a class, record 0
+        if (gt_classes_records[i].empty() || pred_classes_records[i].empty()) {
+            continue;
+        }
+
+        int true_positive_count = 0;
+        APs[i] = calc_AP(gt_classes_records[i], pred_classes_records[i], num_images, iou_threshold, true_positive_count);
+
+        precisions[i] = double(true_positive_count) / pred_classes_records[i].size();
+        recalls[i] = double(true_positive_count) / gt_classes_records[i].size();
+    }
+
+    // like eval.py, precision & recall are averaged over classes with
+    // gt obj, while AP over all classes
+    int gt_class_count = 0;
+    double precision_sum = 0.0, recall_sum = 0.0;
+    for (int i = 0; i < num_classes; i++) {
+        if (!gt_classes_records[i].empty()) {
+            gt_class_count++;
+            precision_sum += precisions[i];
+            recall_sum += recalls[i];
+        }
+    }
+    mPrec = gt_class_count ? precision_sum / gt_class_count * 100 : 0.0;
+    mRec = gt_class_count ? recall_sum / gt_class_count * 100 : 0.0;
+
+    // get mAP percentage value
+    return std::accumulate(APs.begin(), APs.end(), 0.0) / num_classes * 100;
+}
+
+
+double round_to(double value, int digits)
+{
+    double factor = pow(10.0, digits);
+    return round(value * factor) / factor;
+}
+
+
+// compute MSCOCO AP on IoU 0.50:0.05:0.90, same as the threshold list in eval.py
+double compute_AP_COCO(const t_class_records& gt_classes_records, const t_class_records& pred_classes_records,
+                       const int num_images, bool show_result)
+{
+    std::vector<double> APs, precisions, recalls;
+    double mPrec, mRec;
+    double AP = 0.0;
+    int iou_threshold_num = 9;
+
+    if (show_result) {
+        MNN_PRINT("\nMS COCO AP evaluation\n");
+    }
+    for (int i = 0; i < iou_threshold_num; i++) {
+        double iou_threshold = round_to(0.5 + 0.05 * i, 2);
+        double mAP = compute_mAP_PascalVOC(gt_classes_records, pred_classes_records, num_images, iou_threshold,
+                                           APs, mPrec, mRec, precisions, recalls);
+        mAP = round_to(mAP, 6);
+        AP += mAP;
+
+        if (show_result) {
+            MNN_PRINT("IOU %.2f: AP %f\n", iou_threshold, mAP);
+        }
+    }
+    AP /= iou_threshold_num;
+
+    if (show_result) {
+        MNN_PRINT("total AP: %f\n", AP);
+    }
+
+    return AP;
+}
+
+
+// compute MSCOCO AP on small (area <= 32^2), medium (32^2 < area <= 96^2)
+// and large (area > 96^2) ground truth objects
+void compute_AP_COCO_Scale(const t_class_records& gt_classes_records, const t_class_records& pred_classes_records,
+                           const int num_images)
+{
+    const char* scale_names[] = {"small", "medium", "large"};
+    const int scale_num = 3;
+    t_class_records scale_gt_classes_records[scale_num];
+    double scale_APs[scale_num];
+
+    for (int i = 0; i < scale_num; i++) {
+        scale_gt_classes_records[i].resize(gt_classes_records.size());
+    }
+
+    for (size_t i = 0; i < gt_classes_records.size(); i++) {
+        for (auto& gt_record : gt_classes_records[i]) {
+            double box_area = (gt_record.xmax - gt_record.xmin) * (gt_record.ymax - gt_record.ymin);
+
+            if (box_area <= 32*32) {
+                scale_gt_classes_records[0][i].emplace_back(gt_record);
+            } else if (box_area <= 96*96) {
+                scale_gt_classes_records[1][i].emplace_back(gt_record);
+            } else {
+                scale_gt_classes_records[2][i].emplace_back(gt_record);
+            }
+        }
+    }
+
+    double scale_mAP = 0.0;
+    for (int i = 0; i < scale_num; i++) {
+        scale_APs[i] = round_to(compute_AP_COCO(scale_gt_classes_records[i], pred_classes_records, num_images, false), 4);
+        scale_mAP += scale_APs[i];
+    }
+    scale_mAP /= scale_num;
+
+    MNN_PRINT("\nMS COCO AP evaluation on different scale\n");
+    for (int i = 0; i < scale_num; i++) {
+        MNN_PRINT("%s scale: AP %f\n", scale_names[i], scale_APs[i]);
+    }
+    MNN_PRINT("total AP: %f\n", scale_mAP);
+
+    return;
+}
+
+
+// transform the NMS result of one image to prediction records like
+// eval.py: round & clip the box to image, and keep top 100 score boxes
+void get_prediction_records(std::vector<t_prediction>& prediction_nms_list, const int image_index,
+                            const int image_width, const int image_height, t_class_records& pred_classes_records)
+{
+    const size_t max_boxes = 100;
+
+    std::stable_sort(prediction_nms_list.begin(), prediction_nms_list.end(),
+                     [](const t_prediction& lpred, const t_prediction& rpred) {
+                         return lpred.confidence > rpred.confidence;
+                     });
+    if (prediction_nms_list.size() > max_boxes) {
+        prediction_nms_list.resize(max_boxes);
+    }
+
+    for (auto& prediction_nms : prediction_nms_list) {
+        t_box_record pred_record;
+        pred_record.image_index = image_index;
+        pred_record.xmin = std::max(0.0, floor(prediction_nms.x + 0.5));
+        pred_record.ymin = std::max(0.0, floor(prediction_nms.y + 0.5));
+        pred_record.xmax = std::min(double(image_width), floor(prediction_nms.x + prediction_nms.width + 0.5));
+        pred_record.ymax = std::min(double(image_height), floor(prediction_nms.y + prediction_nms.height + 0.5));
+        pred_record.score = prediction_nms.confidence;
+
+        pred_classes_records[prediction_nms.class_index].emplace_back(pred_record);
+    }
+
+    return;
+}
+
+
+void RunEvaluation(Settings* s) {
+    // record run time for every stage
+    struct timeval start_time, stop_time;
+
+    // get classes labels & anchor value
+    std::vector<std::string> classes;
+    std::vector<std::pair<float, float>> anchors;
+    load_classes_anchors(s, classes, anchors);
+    int num_classes = classes.size();
+    MNN_PRINT("num_classes: %d\n", num_classes);
+
+    // get annotation lines & ground truth records
+    std::vector<std::string> annotation_lines;
+    std::ifstream annotationOs(s->annotation_file_name.c_str());
+    if (!annotationOs) {
+        MNN_ERROR("Can't open %s\n", s->annotation_file_name.c_str());
+        return;
+    }
+    std::string line;
+    while (std::getline(annotationOs, line)) {
+        annotation_lines.emplace_back(line);
+    }
+
+    std::vector<std::string> image_names;
+    t_class_records gt_classes_records;
+    annotation_parse(annotation_lines, num_classes, image_names, gt_classes_records);
+    int num_images = image_names.size();
+    MNN_PRINT("annotation image number: %d\n", num_images);
+
+    // do detection on images with worker threads, and keep the
+    // predictions of every image to form up records in annotation order
+    std::vector<std::vector<t_prediction>> image_predictions(num_images);
+    std::vector<int> image_widths(num_images, 0), image_heights(num_images, 0);
+
+    gettimeofday(&start_time, nullptr);
+    int num_workers = detect_image_list(image_names, num_classes, anchors,
+        [&](int image_index, int image_width, int image_height, std::vector<t_prediction>& prediction_nms_list) {
+            image_predictions[image_index].swap(prediction_nms_list);
+            image_widths[image_index] = image_width;
+            image_heights[image_index] = image_height;
+        }, s);
+    if (num_workers < 0) {
+        return;
+    }
+    gettimeofday(&stop_time, nullptr);
+    MNN_PRINT("detection time: %lf ms, %d workers\n", (get_us(stop_time) - get_us(start_time)) / 1000, num_workers);
+
+    // form up prediction class records, sorted by score
+    t_class_records pred_classes_records(num_classes);
+    for (int i = 0; i < num_images; i++) {
+        get_prediction_records(image_predictions[i], i, image_widths[i], image_heights[i], pred_classes_records);
+    }
+    for (auto& pred_records : pred_classes_records) {
+        std::stable_sort(pred_records.begin(), pred_records.end(),
+                         [](const t_box_record& lrecord, const t_box_record& rrecord) {
+                             return lrecord.score > rrecord.score;
+                         });
+    }
+
+    if (s->eval_type == "VOC") {
+        std::vector<double> APs, precisions, recalls;
+        double mPrec, mRec;
+        double mAP = compute_mAP_PascalVOC(gt_classes_records, pred_classes_records, num_images, s->eval_iou_threshold,
+                                           APs, mPrec, mRec, precisions, recalls);
+
+        MNN_PRINT("\nPascal VOC AP evaluation\n");
+        for (int i = 0; i < num_classes; i++) {
+            MNN_PRINT("%s: AP %.4f, precision %.4f, recall %.4f\n", classes[i].c_str(), APs[i], precisions[i], recalls[i]);
+        }
+        MNN_PRINT("mAP@IoU=%.2f result: %f\n", s->eval_iou_threshold, mAP);
+        MNN_PRINT("mPrec@IoU=%.2f result: %f\n", s->eval_iou_threshold, mPrec);
+        MNN_PRINT("mRec@IoU=%.2f result: %f\n", s->eval_iou_threshold, mRec);
+    } else if (s->eval_type == "COCO") {
+        compute_AP_COCO(gt_classes_records, pred_classes_records, num_images, true);
+        // get AP for different scale: small, medium, large
+        compute_AP_COCO_Scale(gt_classes_records, pred_classes_records, num_images);
+    } else {
+        MNN_ERROR("Unsupported evaluation type %s\n", s->eval_type.c_str());
+    }
+
+    return;
+}
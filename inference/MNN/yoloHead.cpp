@@ -0,0 +1,322 @@
+//
+//  yoloHead.cpp
+//  MNN
+//
+//  Decode plan of YOLO head output layers
+//
+
+#include <stdlib.h>
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <sstream>
+#include "MNN/MNNDefine.h"
+#include "yoloHead.h"
+
+using namespace MNN;
+
+
+// strip spaces & tabs at both ends
+static std::string strip(const std::string& str)
+{
+    size_t start = str.find_first_not_of(" \t\r");
+    if (start == std::string::npos) {
+        return "";
+    }
+    size_t end = str.find_last_not_of(" \t\r");
+    return str.substr(start, end - start + 1);
+}
+
+
+bool load_head_config(const std::string& file_name, t_head_config& config)
+{
+    std::ifstream configOs(file_name.c_str());
+    if (!configOs.is_open()) {
+        MNN_ERROR("Can't open head config %s\n", file_name.c_str());
+        return false;
+    }
+
+    config.num_classes = 0;
+    config.layers.clear();
+
+    // current section is [yolo]/[region], or other darknet section to skip
+    bool in_head = false;
+    std::string line;
+    while (std::getline(configOs, line)) {
+        // drop comment
+        size_t comment = line.find_first_of("#;");
+        if (comment != std::string::npos) {
+            line = line.substr(0, comment);
+        }
+        line = strip(line);
+        if (line.empty()) {
+            continue;
+        }
+
+        if (line[0] == '[') {
+            in_head = (line == "[yolo]" || line == "[region]");
+            if (in_head) {
+                t_head_config_layer layer;
+                if (line == "[region]") {
+                    // YOLOv2 region layer
+                    layer.head_type = HEAD_SOFTMAX;
+                    layer.grid_anchors = true;
+                }
+                config.layers.emplace_back(layer);
+            }
+            continue;
+        }
+        if (!in_head) {
+            continue;
+        }
+
+        size_t equal = line.find('=');
+        if (equal == std::string::npos) {
+            MNN_ERROR("Invalid head config line: %s\n", line.c_str());
+            return false;
+        }
+        std::string key = strip(line.substr(0, equal));
+        std::string value = strip(line.substr(equal + 1));
+        t_head_config_layer& layer = config.layers.back();
+
+        if (key == "mask") {
+            std::stringstream maskOs(value);
+            std::string index;
+            while (std::getline(maskOs, index, ',')) {
+                layer.mask.emplace_back(atoi(index.c_str()));
+            }
+        } else if (key == "anchors") {
+            parse_anchors(value, layer.anchors);
+        } else if (key == "stride") {
+            layer.stride = atoi(value.c_str());
+        } else if (key == "scoring") {
+            if (value == "sigmoid") {
+                layer.head_type = HEAD_SIGMOID;
+            } else if (value == "softmax") {
+                layer.head_type = HEAD_SOFTMAX;
+            } else {
+                MNN_ERROR("Invalid head scoring %s, should be sigmoid or softmax\n", value.c_str());
+                return false;
+            }
+        } else if (key == "softmax") {
+            // darknet [region] option
+            layer.head_type = atoi(value.c_str()) ? HEAD_SOFTMAX : HEAD_SIGMOID;
+        } else if (key == "classes") {
+            config.num_classes = atoi(value.c_str());
+        }
+        // other darknet options (num, jitter, etc.) are for training
+    }
+
+    if (config.layers.empty()) {
+        MNN_ERROR("No [yolo] or [region] layer in head config %s\n", file_name.c_str());
+        return false;
+    }
+    return true;
+}
+
+
+bool default_head_config(const int num_anchors, const int num_layers, t_head_config& config)
+{
+    config.num_classes = 0;
+    config.layers.clear();
+
+    // YOLOv2 has 1 output layer with all anchors
+    if (num_layers == 1) {
+        t_head_config_layer layer;
+        layer.head_type = HEAD_SOFTMAX;
+        config.layers.emplace_back(layer);
+        return true;
+    }
+
+    // YOLOv3 has 3 layers x 3 anchors, Tiny YOLOv3 2 layers x 3 anchors
+    if (num_layers == 0 || num_anchors % num_layers != 0) {
+        MNN_ERROR("Can't split %d anchors to %d output layers, need a head config\n", num_anchors, num_layers);
+        return false;
+    }
+    int anchor_num_per_layer = num_anchors / num_layers;
+    for (int i = 0; i < num_layers; i++) {
+        t_head_config_layer layer;
+        for (int j = 0; j < anchor_num_per_layer; j++) {
+            layer.mask.emplace_back(i * anchor_num_per_layer + j);
+        }
+        config.layers.emplace_back(layer);
+    }
+    return true;
+}
+
+
+// mean anchor area of config layer, to match output layer by stride
+static float layer_anchor_area(const t_head_config_layer& layer, const std::vector<std::pair<float, float>>& anchors)
+{
+    const std::vector<std::pair<float, float>>& layer_anchors = layer.anchors.empty() ? anchors : layer.anchors;
+    float area = 0;
+    int count = 0;
+    for (size_t i = 0; i < layer_anchors.size(); i++) {
+        if (layer.mask.empty() || std::find(layer.mask.begin(), layer.mask.end(), int(i)) != layer.mask.end()) {
+            area += layer_anchors[i].first * layer_anchors[i].second;
+            count++;
+        }
+    }
+    return count ? area / count : 0;
+}
+
+
+void build_head_plan(Interpreter* net, Session* session, const std::vector<std::pair<float, float>>& anchors,
+                     const int num_classes, const t_head_config& config, t_head_plan& plan)
+{
+    auto image_input = net->getSessionInputAll(session).begin()->second;
+    plan.input_width = image_input->width();
+    plan.input_height = image_input->height();
+    plan.num_classes = num_classes;
+    plan.layers.clear();
+
+    if (config.num_classes > 0 && config.num_classes != num_classes) {
+        MNN_ERROR("Head config has %d classes, but classes file has %d\n", config.num_classes, num_classes);
+        exit(-1);
+    }
+
+    auto outputs = net->getSessionOutputAll(session);
+    for (auto output : outputs) {
+        auto output_tensor = output.second;
+
+        t_head_layer layer;
+        layer.name = output.first;
+        layer.width = output_tensor->width();
+        layer.height = output_tensor->height();
+        layer.channel = output_tensor->channel();
+
+        // stride could confirm the feature map level:
+        // image_input: 1 x 416 x 416 x 3
+        // stride 32: 1 x 13 x 13 x 3 x (num_classes + 5)
+        // stride 16: 1 x 26 x 26 x 3 x (num_classes + 5)
+        // stride 8: 1 x 52 x 52 x 3 x (num_classes + 5)
+        // input & feature map could be rectangular (e.g. 608x352 -> 19x11)
+        // but stride on width and height should be same
+        layer.stride = plan.input_width / layer.width;
+        if (plan.input_height / layer.height != layer.stride) {
+            MNN_ERROR("mismatch feature map stride on width & height of %s!\n", layer.name.c_str());
+            exit(-1);
+        }
+        plan.layers.emplace_back(layer);
+    }
+
+    if (config.layers.size() != plan.layers.size()) {
+        MNN_ERROR("Head config has %d layers, but model has %d outputs\n", int(config.layers.size()), int(plan.layers.size()));
+        exit(-1);
+    }
+
+    // match config layer to output layer: by stride if specified, else
+    // by order of stride & anchor size, as larger anchors are always
+    // predicted on coarser feature map
+    std::vector<int> output_order(plan.layers.size()), config_order(config.layers.size());
+    std::iota(output_order.begin(), output_order.end(), 0);
+    std::iota(config_order.begin(), config_order.end(), 0);
+    std::stable_sort(output_order.begin(), output_order.end(), [&](int a, int b) {
+        return plan.layers[a].stride < plan.layers[b].stride;
+    });
+    std::stable_sort(config_order.begin(), config_order.end(), [&](int a, int b) {
+        return layer_anchor_area(config.layers[a], anchors) < layer_anchor_area(config.layers[b], anchors);
+    });
+
+    std::vector<bool> config_used(config.layers.size(), false);
+    for (size_t i = 0; i < output_order.size(); i++) {
+        t_head_layer& layer = plan.layers[output_order[i]];
+
+        int config_index = -1;
+        for (size_t j = 0; j < config.layers.size(); j++) {
+            if (config.layers[j].stride == layer.stride) {
+                config_index = j;
+                break;
+            }
+        }
+        if (config_index < 0) {
+            // next unused config layer without stride, in anchor size order
+            for (size_t j = 0; j < config_order.size(); j++) {
+                if (config.layers[config_order[j]].stride == 0 && !config_used[config_order[j]]) {
+                    config_index = config_order[j];
+                    break;
+                }
+            }
+        }
+        if (config_index < 0 || config_used[config_index]) {
+            MNN_ERROR("No head config layer for output %s (stride %d)\n", layer.name.c_str(), layer.stride);
+            exit(-1);
+        }
+        config_used[config_index] = true;
+
+        // pick anchors of the layer, in input pixels
+        const t_head_config_layer& layer_config = config.layers[config_index];
+        const std::vector<std::pair<float, float>>& config_anchors = layer_config.anchors.empty() ? anchors : layer_config.anchors;
+        const float anchor_scale = layer_config.grid_anchors && !layer_config.anchors.empty() ? layer.stride : 1.0f;
+        if (layer_config.mask.empty()) {
+            layer.anchors = config_anchors;
+        } else {
+            for (auto index : layer_config.mask) {
+                if (index < 0 || index >= int(config_anchors.size())) {
+                    MNN_ERROR("Invalid anchor mask %d of output %s, only %d anchors\n", index, layer.name.c_str(), int(config_anchors.size()));
+                    exit(-1);
+                }
+                layer.anchors.emplace_back(config_anchors[index]);
+            }
+        }
+        for (auto& anchor : layer.anchors) {
+            anchor.first *= anchor_scale;
+            anchor.second *= anchor_scale;
+        }
+        layer.head_type = layer_config.head_type;
+
+        // the featuremap channel should be like 3*(num_classes + 5)
+        if (int(layer.anchors.size()) * (num_classes + 5) != layer.channel) {
+            MNN_ERROR("Output %s has %d channels, mismatch with %d anchors & %d classes\n",
+                      layer.name.c_str(), layer.channel, int(layer.anchors.size()), num_classes);
+            exit(-1);
+        }
+
+        for (int w = 0; w < layer.width; w++) {
+            layer.grid_x.emplace_back(float(w * layer.stride));
+        }
+        for (int h = 0; h < layer.height; h++) {
+            layer.grid_y.emplace_back(float(h * layer.stride));
+        }
+    }
+    return;
+}
+
+
+bool match_head_plan(Interpreter* net, Session* session, const t_head_plan& plan)
+{
+    auto outputs = net->getSessionOutputAll(session);
+    if (outputs.size() != plan.layers.size()) {
+        MNN_ERROR("Head plan has %d layers, but session has %d outputs\n", int(plan.layers.size()), int(outputs.size()));
+        return false;
+    }
+
+    int layer_index = 0;
+    for (auto output : outputs) {
+        const t_head_layer& layer = plan.layers[layer_index++];
+        if (layer.name != output.first) {
+            MNN_ERROR("Head plan layer %s mismatch with session output %s\n", layer.name.c_str(), output.first.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+
+std::shared_ptr<t_head_plan> create_head_plan(Interpreter* net, Session* session, const std::vector<std::pair<float, float>>& anchors,
+                                              const int num_classes, const std::string& head_config_file)
+{
+    t_head_config config;
+    bool loaded = head_config_file.empty()
+                      ? default_head_config(anchors.size(), net->getSessionOutputAll(session).size(), config)
+                      : load_head_config(head_config_file, config);
+    if (!loaded) {
+        exit(-1);
+    }
+
+    auto plan = std::make_shared<t_head_plan>();
+    build_head_plan(net, session, anchors, num_classes, config, *plan);
+    return plan;
+}
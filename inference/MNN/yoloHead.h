@@ -0,0 +1,96 @@
+//
+//  yoloHead.h
+//  MNN
+//
+//  Decode plan of YOLO head output layers, built once for a model
+//  input shape, so per-frame decode only streams over feature maps
+//
+
+#ifndef YOLO_DETECTION_YOLO_HEAD_H_
+#define YOLO_DETECTION_YOLO_HEAD_H_
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <memory>
+#include "MNN/Interpreter.hpp"
+#include "yoloDetection.h"
+
+
+// YOLO head type: YOLOv3 use sigmoid class scores, YOLOv2 softmax
+enum {
+    HEAD_SIGMOID = 0,
+    HEAD_SOFTMAX = 1,
+};
+
+
+// head descriptor of one output layer, from head config file. a
+// darknet model cfg could be used directly, since only [yolo] and
+// [region] sections are picked up:
+//
+//   [yolo]
+//   mask = 6,7,8                # anchor index of the layer
+//   anchors = 10,13, 16,30, ... # optional, else from anchors file
+//   stride = 32                 # optional, else matched by anchor size
+//   scoring = sigmoid           # optional, sigmoid/softmax
+//
+// [region] (YOLOv2) layer use all anchors with softmax scoring, and
+// its anchors are in grid unit
+typedef struct head_config_layer {
+    int stride = 0;             // 0 to match output layer by anchor size
+    int head_type = HEAD_SIGMOID;
+    std::vector<int> mask;      // empty for all anchors
+    std::vector<std::pair<float, float>> anchors;   // empty for anchors file
+    bool grid_anchors = false;  // anchors in grid unit, scaled by stride
+}t_head_config_layer;
+
+typedef struct head_config {
+    int num_classes = 0;        // 0 for not specified
+    std::vector<t_head_config_layer> layers;
+}t_head_config;
+
+
+// decode plan of one output layer
+typedef struct head_layer {
+    std::string name;           // output tensor name
+    int stride;                 // input pixels per grid cell
+    int width;                  // feature map grid size
+    int height;
+    int channel;
+    int head_type;              // HEAD_SIGMOID/HEAD_SOFTMAX
+    std::vector<std::pair<float, float>> anchors;   // anchor size in input pixels
+    std::vector<float> grid_x;  // grid offset in input pixels, w * stride
+    std::vector<float> grid_y;  // h * stride
+}t_head_layer;
+
+// decode plan of all output layers, in order of session output map
+typedef struct head_plan {
+    int input_width;
+    int input_height;
+    int num_classes;
+    std::vector<t_head_layer> layers;
+}t_head_plan;
+
+
+// parse head config (or darknet cfg) file
+bool load_head_config(const std::string& file_name, t_head_config& config);
+
+// default head config without config file: single output layer is
+// YOLOv2 region with softmax scoring, otherwise anchors are split
+// evenly to layers, smaller anchors to smaller stride
+bool default_head_config(const int num_anchors, const int num_layers, t_head_config& config);
+
+// build decode plan of the session outputs for its input shape
+void build_head_plan(MNN::Interpreter* net, MNN::Session* session, const std::vector<std::pair<float, float>>& anchors,
+                     const int num_classes, const t_head_config& config, t_head_plan& plan);
+
+// check decode plan layers match the session outputs in number &
+// order, error is printed on mismatch
+bool match_head_plan(MNN::Interpreter* net, MNN::Session* session, const t_head_plan& plan);
+
+// create decode plan of the session outputs, at session creation.
+// head config is loaded from head_config_file, or default if empty
+std::shared_ptr<t_head_plan> create_head_plan(MNN::Interpreter* net, MNN::Session* session, const std::vector<std::pair<float, float>>& anchors,
+                                              const int num_classes, const std::string& head_config_file);
+
+#endif  // YOLO_DETECTION_YOLO_HEAD_H_
@@ -0,0 +1,229 @@
+//
+//  yoloMotion.cpp
+//  MNN
+//
+//  Frame difference motion gate for static camera, to detect only
+//  the moving regions of a frame
+//
+
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+
+#include "yoloMotion.h"
+
+
+MotionGate::MotionGate()
+    : mWidth(0), mHeight(0), mCellsWidth(0), mCellsHeight(0), mFrameCount(0)
+{
+}
+
+
+// mean grey level of every cell. pixels are sampled with stride 2
+// in cell, which is enough for frame difference
+void MotionGate::get_cells(const t_image_buffer& image, std::vector<uint8_t>& cells)
+{
+    cells.resize(mCellsWidth * mCellsHeight);
+
+    for (int cy = 0; cy < mCellsHeight; cy++) {
+        int y_end = std::min((cy + 1) * MOTION_CELL_SIZE, image.height);
+        for (int cx = 0; cx < mCellsWidth; cx++) {
+            int x_end = std::min((cx + 1) * MOTION_CELL_SIZE, image.width);
+
+            int sum = 0, count = 0;
+            for (int y = cy * MOTION_CELL_SIZE; y < y_end; y += 2) {
+                const uint8_t* pixel = image.data + (y * image.width + cx * MOTION_CELL_SIZE) * image.channel;
+                for (int x = cx * MOTION_CELL_SIZE; x < x_end; x += 2, pixel += 2 * image.channel) {
+                    // (R + 2G + B) / 4 as grey level
+                    sum += (image.channel >= 3) ? (pixel[0] + 2 * pixel[1] + pixel[2]) >> 2 : pixel[0];
+                    count++;
+                }
+            }
+            cells[cy * mCellsWidth + cx] = uint8_t(sum / count);
+        }
+    }
+    return;
+}
+
+
+// update reference of the cells in detected region, by cell center.
+// cells out of detected regions keep the reference, so slow changes
+// accumulate until detected, instead of fading in frame difference
+void MotionGate::update_reference(const std::vector<uint8_t>& cells, const t_image_rect& roi)
+{
+    for (int cy = 0; cy < mCellsHeight; cy++) {
+        int center_y = std::min(cy * MOTION_CELL_SIZE + MOTION_CELL_SIZE / 2, mHeight - 1);
+        if (center_y < roi.y || center_y >= roi.y + roi.height) {
+            continue;
+        }
+        for (int cx = 0; cx < mCellsWidth; cx++) {
+            int center_x = std::min(cx * MOTION_CELL_SIZE + MOTION_CELL_SIZE / 2, mWidth - 1);
+            if (center_x >= roi.x && center_x < roi.x + roi.width) {
+                mRefCells[cy * mCellsWidth + cx] = cells[cy * mCellsWidth + cx];
+            }
+        }
+    }
+    return;
+}
+
+
+void MotionGate::get_rois(const t_image_buffer& image, std::vector<t_image_rect>& rois)
+{
+    t_image_rect whole_frame = {0, 0, image.width, image.height};
+    rois.clear();
+
+    // reset on the first frame or frame shape change
+    bool refresh = false;
+    if (image.width != mWidth || image.height != mHeight) {
+        mWidth = image.width;
+        mHeight = image.height;
+        mCellsWidth = (mWidth + MOTION_CELL_SIZE - 1) / MOTION_CELL_SIZE;
+        mCellsHeight = (mHeight + MOTION_CELL_SIZE - 1) / MOTION_CELL_SIZE;
+        mRefCells.clear();
+        mLastResult.clear();
+        refresh = true;
+    }
+
+    std::vector<uint8_t> cells;
+    get_cells(image, cells);
+    if (refresh || ++mFrameCount >= MOTION_REFRESH_INTERVAL) {
+        mRefCells.swap(cells);
+        mFrameCount = 0;
+        rois.emplace_back(whole_frame);
+        return;
+    }
+
+    // moving cells, dilated by one cell to cover the object edges
+    int num_cells = mCellsWidth * mCellsHeight;
+    std::vector<uint8_t> mask(num_cells, 0);
+    for (int cy = 0; cy < mCellsHeight; cy++) {
+        for (int cx = 0; cx < mCellsWidth; cx++) {
+            int i = cy * mCellsWidth + cx;
+            if (abs(int(cells[i]) - int(mRefCells[i])) <= MOTION_DIFF_THRESHOLD) {
+                continue;
+            }
+            for (int y = std::max(cy - 1, 0); y <= std::min(cy + 1, mCellsHeight - 1); y++) {
+                for (int x = std::max(cx - 1, 0); x <= std::min(cx + 1, mCellsWidth - 1); x++) {
+                    mask[y * mCellsWidth + x] = 1;
+                }
+            }
+        }
+    }
+
+    // bounding box of every connected moving area, enlarged to
+    // min ROI size and clamped into frame
+    std::vector<int> stack;
+    for (int i = 0; i < num_cells; i++) {
+        if (mask[i] != 1) {
+            continue;
+        }
+        int x_min = mCellsWidth, y_min = mCellsHeight, x_max = -1, y_max = -1;
+        mask[i] = 2;
+        stack.emplace_back(i);
+        while (!stack.empty()) {
+            int cell = stack.back();
+            stack.pop_back();
+            int cx = cell % mCellsWidth;
+            int cy = cell / mCellsWidth;
+            x_min = std::min(x_min, cx);
+            y_min = std::min(y_min, cy);
+            x_max = std::max(x_max, cx);
+            y_max = std::max(y_max, cy);
+
+            for (int y = std::max(cy - 1, 0); y <= std::min(cy + 1, mCellsHeight - 1); y++) {
+                for (int x = std::max(cx - 1, 0); x <= std::min(cx + 1, mCellsWidth - 1); x++) {
+                    if (mask[y * mCellsWidth + x] == 1) {
+                        mask[y * mCellsWidth + x] = 2;
+                        stack.emplace_back(y * mCellsWidth + x);
+                    }
+                }
+            }
+        }
+
+        t_image_rect roi;
+        roi.x = x_min * MOTION_CELL_SIZE;
+        roi.y = y_min * MOTION_CELL_SIZE;
+        roi.width = std::min((x_max + 1) * MOTION_CELL_SIZE, mWidth) - roi.x;
+        roi.height = std::min((y_max + 1) * MOTION_CELL_SIZE, mHeight) - roi.y;
+
+        if (roi.width < MOTION_MIN_ROI_SIZE) {
+            int width = std::min(MOTION_MIN_ROI_SIZE, mWidth);
+            roi.x = std::min(std::max(roi.x + roi.width / 2 - width / 2, 0), mWidth - width);
+            roi.width = width;
+        }
+        if (roi.height < MOTION_MIN_ROI_SIZE) {
+            int height = std::min(MOTION_MIN_ROI_SIZE, mHeight);
+            roi.y = std::min(std::max(roi.y + roi.height / 2 - height / 2, 0), mHeight - height);
+            roi.height = height;
+        }
+        rois.emplace_back(roi);
+    }
+
+    // merge overlapped ROIs, until none of them overlaps
+    bool merged = true;
+    while (merged) {
+        merged = false;
+        for (int i = 0; i < rois.size() && !merged; i++) {
+            for (int j = i + 1; j < rois.size() && !merged; j++) {
+                auto& a = rois[i];
+                auto& b = rois[j];
+                if (a.x < b.x + b.width && b.x < a.x + a.width && a.y < b.y + b.height && b.y < a.y + a.height) {
+                    int x = std::min(a.x, b.x);
+                    int y = std::min(a.y, b.y);
+                    a.width = std::max(a.x + a.width, b.x + b.width) - x;
+                    a.height = std::max(a.y + a.height, b.y + b.height) - y;
+                    a.x = x;
+                    a.y = y;
+                    rois.erase(rois.begin() + j);
+                    merged = true;
+                }
+            }
+        }
+    }
+
+    // too many or too large ROIs save little, so detect whole frame
+    long long roi_area = 0;
+    for (auto& roi : rois) {
+        roi_area += roi.width * roi.height;
+    }
+    if (rois.size() > MOTION_MAX_ROIS || roi_area > MOTION_MAX_ROI_AREA * mWidth * mHeight) {
+        mFrameCount = 0;
+        rois.assign(1, whole_frame);
+    }
+
+    for (auto& roi : rois) {
+        update_reference(cells, roi);
+    }
+    return;
+}
+
+
+void MotionGate::merge(const std::vector<t_image_rect>& rois, const std::vector<std::vector<t_prediction>>& roi_prediction_lists,
+                       const int num_classes, const float iou_threshold, std::vector<t_prediction>& prediction_nms_list)
+{
+    std::vector<t_prediction> prediction_list;
+    for (auto& prediction : mLastResult) {
+        float center_x = prediction.x + prediction.width / 2;
+        float center_y = prediction.y + prediction.height / 2;
+        bool in_roi = std::any_of(rois.begin(), rois.end(), [center_x, center_y](const t_image_rect& roi) {
+            return center_x >= roi.x && center_x < roi.x + roi.width && center_y >= roi.y && center_y < roi.y + roi.height;
+        });
+        if (!in_roi) {
+            prediction_list.emplace_back(prediction);
+        }
+    }
+
+    for (int i = 0; i < rois.size(); i++) {
+        for (auto prediction : roi_prediction_lists[i]) {
+            prediction.x += rois[i].x;
+            prediction.y += rois[i].y;
+            prediction_list.emplace_back(prediction);
+        }
+    }
+
+    // NMS removes duplicate boxes of objects across ROI border
+    mLastResult.clear();
+    nms_boxes(prediction_list, mLastResult, num_classes, iou_threshold);
+    prediction_nms_list.insert(prediction_nms_list.end(), mLastResult.begin(), mLastResult.end());
+    return;
+}
@@ -0,0 +1,57 @@
+//
+//  yoloMotion.h
+//  MNN
+//
+//  Frame difference motion gate for static camera, to detect only
+//  the moving regions of a frame
+//
+
+#ifndef YOLO_DETECTION_YOLO_MOTION_H_
+#define YOLO_DETECTION_YOLO_MOTION_H_
+
+#include <vector>
+#include "yoloDetection.h"
+
+// motion is detected on grey frame downscaled by cells, and a cell is
+// moving if its mean grey level changes more than the threshold
+#define MOTION_CELL_SIZE 8
+#define MOTION_DIFF_THRESHOLD 20
+
+#define MOTION_MIN_ROI_SIZE 160         // min ROI size in pixel, to keep some context for model
+#define MOTION_MAX_ROIS 4               // detect whole frame if more ROIs
+#define MOTION_MAX_ROI_AREA 0.5f        // detect whole frame if ROIs cover more area ratio
+#define MOTION_REFRESH_INTERVAL 30      // frames between whole frame detections
+
+
+// motion gate state of one video stream
+class MotionGate {
+public:
+    MotionGate();
+
+    // compare frame with the reference, and get the regions to detect:
+    //   empty: nothing moves, last result could be reused
+    //   whole frame: first/refresh frame, frame shape change, or too
+    //                large moving area
+    //   otherwise: ROIs around the moving cells
+    void get_rois(const t_image_buffer& image, std::vector<t_image_rect>& rois);
+
+    // merge detection result of the ROIs into last frame result: boxes
+    // centered in ROIs are replaced by the ROI predictions offset back
+    // to frame coordinate. merged result is kept for following frames
+    void merge(const std::vector<t_image_rect>& rois, const std::vector<std::vector<t_prediction>>& roi_prediction_lists,
+               const int num_classes, const float iou_threshold, std::vector<t_prediction>& prediction_nms_list);
+
+private:
+    void get_cells(const t_image_buffer& image, std::vector<uint8_t>& cells);
+    void update_reference(const std::vector<uint8_t>& cells, const t_image_rect& roi);
+
+    int mWidth;
+    int mHeight;
+    int mCellsWidth;
+    int mCellsHeight;
+    int mFrameCount;                    // frames since last whole frame detection
+    std::vector<uint8_t> mRefCells;     // cells of frames when last detected
+    std::vector<t_prediction> mLastResult;
+};
+
+#endif  // YOLO_DETECTION_YOLO_MOTION_H_
@@ -0,0 +1,739 @@
+//
+//  yoloServer.cpp
+//  MNN
+//
+//  Local detection server with dynamic request batching
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "MNN/Interpreter.hpp"
+#include "stb_image.h"
+
+#include "yoloDetection.h"
+#include "yoloServer.h"
+#include "shmRing.h"
+#include "yoloTracker.h"
+#include "yoloMotion.h"
+
+using namespace MNN;
+
+
+// detection request waiting in batch queue
+typedef struct pending_request {
+    t_image_buffer image;
+    int input_width;
+    int input_height;
+    std::vector<t_prediction> prediction_nms_list;
+    std::chrono::steady_clock::time_point arrive_time;
+    bool done;
+}t_pending_request;
+
+
+// queue shared by client connections and batch runner
+static std::mutex g_queue_mutex;
+static std::condition_variable g_queue_cond;
+static std::condition_variable g_done_cond;
+static std::deque<t_pending_request*> g_request_queue;
+
+// set once batch runner has stopped and dropped the queued requests
+static bool g_runner_stopped = false;
+
+// busy ratio of batch runner, as load feedback of frame skipping
+static std::atomic<float> g_busy_ratio(0.0f);
+
+// max model input size of request, i.e. the default input size, so a
+// client can't force huge sessions
+static int g_max_input_width = 0;
+static int g_max_input_height = 0;
+
+// stop flag of server & shm detection, set by SIGINT/SIGTERM. loops
+// poll it, so blocking waits are bounded by this interval
+static std::atomic<bool> g_stop(false);
+static const auto STOP_POLL_INTERVAL = std::chrono::milliseconds(100);
+
+// client connection threads, joined when finished or on stop. the
+// socket fd is closed only after join, so the fd is not reused while
+// the thread is tracked
+static std::mutex g_connection_mutex;
+static std::map<int, std::thread> g_connection_threads;
+static std::vector<int> g_finished_connections;
+
+
+static void stop_handler(int signum)
+{
+    g_stop.store(true);
+}
+
+
+static void install_stop_handler()
+{
+    // no SA_RESTART, so blocking calls return with EINTR on stop
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stop_handler;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    return;
+}
+
+
+static bool read_full(int fd, void* buffer, size_t size)
+{
+    uint8_t* data = (uint8_t*)buffer;
+    while (size > 0) {
+        ssize_t ret = recv(fd, data, size, 0);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            return false;
+        }
+        data += ret;
+        size -= ret;
+    }
+    return true;
+}
+
+
+static bool write_full(int fd, const void* buffer, size_t size)
+{
+    const uint8_t* data = (const uint8_t*)buffer;
+    while (size > 0) {
+        ssize_t ret = send(fd, data, size, MSG_NOSIGNAL);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            return false;
+        }
+        data += ret;
+        size -= ret;
+    }
+    return true;
+}
+
+
+// serve requests of one client connection until it's closed. the
+// requests of a connection are regarded as frames of one stream for
+// tracking, frame skipping and motion gate
+static void handle_connection(int fd, int num_classes, Settings* s)
+{
+    // frame skipping relies on tracker prediction
+    bool track = s->track || s->skip_frames > 1;
+    Tracker tracker;
+    FrameSkipper skipper(s->skip_frames);
+    MotionGate motion_gate;
+    t_server_request request;
+    std::vector<uint8_t> request_data;
+    uint32_t request_index = 0;
+
+    while (read_full(fd, &request, sizeof(request))) {
+        if (memcmp(request.magic, "YREQ", 4) != 0 || request.data_size > SERVER_MAX_REQUEST_SIZE ||
+            request.input_width % 32 != 0 || request.input_height % 32 != 0 ||
+            (request.input_width == 0) != (request.input_height == 0) ||
+            request.input_width > (uint32_t)g_max_input_width || request.input_height > (uint32_t)g_max_input_height) {
+            MNN_ERROR("Invalid request header, close connection\n");
+            break;
+        }
+        request_data.resize(request.data_size);
+        if (!read_full(fd, request_data.data(), request_data.size())) {
+            break;
+        }
+
+        // decode image data
+        t_image_buffer image;
+        image.data = nullptr;
+        image.width = 0;
+        image.height = 0;
+        image.channel = 3;
+
+        // skipped frame is not decoded, only image shape is needed
+        bool skip = (s->skip_frames > 1 && !skipper.need_detect());
+        bool valid = false;
+        // decoded image is freed on every exit of the request, including
+        // the connection close on batch runner stop
+        std::unique_ptr<uint8_t, void (*)(void*)> decoded_data(nullptr, stbi_image_free);
+        if (request.format == REQUEST_ENCODED) {
+            int image_channel;
+            if (skip) {
+                valid = stbi_info_from_memory(request_data.data(), request_data.size(),
+                                              &image.width, &image.height, &image_channel);
+            } else {
+                image.data = (uint8_t*)stbi_load_from_memory(request_data.data(), request_data.size(),
+                                              &image.width, &image.height, &image_channel, 3);
+                decoded_data.reset(image.data);
+                valid = (image.data != nullptr);
+            }
+        } else if (request.format == REQUEST_RGB && uint64_t(request.width) * request.height * 3 == request.data_size &&
+                   request.width > 0 && request.height > 0) {
+            image.data = request_data.data();
+            image.width = request.width;
+            image.height = request.height;
+            valid = true;
+        }
+        if (!valid) {
+            image.width = 0;
+            image.height = 0;
+        }
+
+        std::vector<t_prediction> prediction_nms_list;
+        if (valid && !skip) {
+            // with motion gate, only the moving regions are detected
+            std::vector<t_image_rect> rois;
+            std::vector<std::vector<uint8_t>> roi_datas;
+            std::vector<t_pending_request> pendings;
+            if (s->motion_gate) {
+                motion_gate.get_rois(image, rois);
+                roi_datas.resize(rois.size());
+            }
+            int num_pendings = s->motion_gate ? rois.size() : 1;
+            pendings.resize(num_pendings);
+            for (int i = 0; i < num_pendings; i++) {
+                bool whole_frame = !s->motion_gate || (rois[i].width == image.width && rois[i].height == image.height);
+                pendings[i].image = whole_frame ? image : crop_image(image, rois[i], roi_datas[i]);
+                pendings[i].input_width = request.input_width;
+                pendings[i].input_height = request.input_height;
+                pendings[i].done = false;
+            }
+
+            if (num_pendings > 0) {
+                // push to batch queue and wait for the result, or the
+                // batch runner stop, which drops the queued requests
+                std::unique_lock<std::mutex> lock(g_queue_mutex);
+                if (g_runner_stopped) {
+                    break;
+                }
+                auto arrive_time = std::chrono::steady_clock::now();
+                for (auto& pending : pendings) {
+                    pending.arrive_time = arrive_time;
+                    g_request_queue.emplace_back(&pending);
+                }
+                g_queue_cond.notify_one();
+                g_done_cond.wait(lock, [&pendings] {
+                    return g_runner_stopped ||
+                           std::all_of(pendings.begin(), pendings.end(), [](const t_pending_request& p) { return p.done; });
+                });
+                if (!std::all_of(pendings.begin(), pendings.end(), [](const t_pending_request& p) { return p.done; })) {
+                    break;
+                }
+            }
+
+            if (s->motion_gate) {
+                std::vector<std::vector<t_prediction>> roi_prediction_lists;
+                for (auto& pending : pendings) {
+                    roi_prediction_lists.emplace_back(std::move(pending.prediction_nms_list));
+                }
+                motion_gate.merge(rois, roi_prediction_lists, num_classes, s->iou_threshold, prediction_nms_list);
+            } else {
+                prediction_nms_list.swap(pendings[0].prediction_nms_list);
+            }
+        }
+
+        decoded_data.reset();
+
+        if (valid && skip) {
+            tracker.predict(prediction_nms_list);
+        } else if (valid && track) {
+            std::vector<t_prediction> tracked_list;
+            tracker.update(prediction_nms_list, tracked_list);
+            prediction_nms_list.swap(tracked_list);
+            if (s->skip_frames > 1) {
+                skipper.adjust(tracker.get_motion(), g_busy_ratio.load());
+            }
+        }
+
+        // response with image record and object records
+        std::vector<t_result_record> records;
+        t_result_record record;
+        record.image_index = request_index++;
+        record.class_index = -1;
+        record.confidence = prediction_nms_list.size();
+        record.x = 0;
+        record.y = 0;
+        record.width = image.width;
+        record.height = image.height;
+        record.track_id = -1;
+        records.emplace_back(record);
+
+        for (auto& prediction_nms : prediction_nms_list) {
+            record.class_index = prediction_nms.class_index;
+            record.confidence = prediction_nms.confidence;
+            record.x = prediction_nms.x;
+            record.y = prediction_nms.y;
+            record.width = prediction_nms.width;
+            record.height = prediction_nms.height;
+            record.track_id = prediction_nms.track_id;
+            records.emplace_back(record);
+        }
+        if (!write_full(fd, records.data(), records.size() * sizeof(t_result_record))) {
+            break;
+        }
+    }
+
+    // fd is closed by the accept thread after join
+    std::lock_guard<std::mutex> lock(g_connection_mutex);
+    g_finished_connections.emplace_back(fd);
+    return;
+}
+
+
+// join finished connection threads (all of them on stop) and close
+// their sockets
+static void join_connections(bool all)
+{
+    std::vector<std::pair<int, std::thread>> threads;
+    {
+        std::lock_guard<std::mutex> lock(g_connection_mutex);
+        if (all) {
+            // wake up connections blocked on socket read
+            for (auto& connection : g_connection_threads) {
+                shutdown(connection.first, SHUT_RDWR);
+            }
+            for (auto& connection : g_connection_threads) {
+                threads.emplace_back(connection.first, std::move(connection.second));
+            }
+            g_connection_threads.clear();
+        } else {
+            for (auto fd : g_finished_connections) {
+                threads.emplace_back(fd, std::move(g_connection_threads.at(fd)));
+                g_connection_threads.erase(fd);
+            }
+        }
+        g_finished_connections.clear();
+    }
+
+    for (auto& thread : threads) {
+        thread.second.join();
+        close(thread.first);
+    }
+    return;
+}
+
+
+// numeric server address is a localhost TCP port, otherwise it's the
+// path of Unix domain socket
+static bool is_port_address(const std::string& address)
+{
+    return !address.empty() && address.find_first_not_of("0123456789") == std::string::npos;
+}
+
+
+// create listen socket of the server address
+static int create_listen_socket(const std::string& address)
+{
+    int fd;
+
+    if (is_port_address(address)) {
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(atoi(address.c_str()));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        int opt = 1;
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd >= 0) {
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+        }
+        if (fd < 0 || bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+            MNN_ERROR("Can't bind to localhost port %s: %s\n", address.c_str(), strerror(errno));
+            if (fd >= 0) {
+                close(fd);
+            }
+            return -1;
+        }
+    } else {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (address.size() >= sizeof(addr.sun_path)) {
+            MNN_ERROR("Too long socket path %s\n", address.c_str());
+            return -1;
+        }
+        strncpy(addr.sun_path, address.c_str(), sizeof(addr.sun_path) - 1);
+        unlink(address.c_str());
+
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0 || bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+            MNN_ERROR("Can't bind to socket %s: %s\n", address.c_str(), strerror(errno));
+            if (fd >= 0) {
+                close(fd);
+            }
+            return -1;
+        }
+    }
+
+    if (listen(fd, 64) < 0) {
+        MNN_ERROR("Can't listen on %s: %s\n", address.c_str(), strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+
+void RunServer(Settings* s) {
+    std::vector<std::string> classes;
+    std::vector<std::pair<float, float>> anchors;
+    load_classes_anchors(s, classes, anchors);
+    int num_classes = classes.size();
+    MNN_PRINT("num_classes: %d\n", num_classes);
+
+    // create model, and sessions for every batch size & input size
+    // are created on demand and cached, to avoid re-planning
+    std::shared_ptr<Interpreter> net(Interpreter::createFromFile(s->model_name.c_str()));
+    if (net == nullptr) {
+        MNN_ERROR("Can't load model %s\n", s->model_name.c_str());
+        return;
+    }
+    int max_batch_size = std::max(1, s->max_batch_size);
+    t_session_cache session_cache;
+    auto default_session = get_cached_session(net.get(), s, session_cache, num_classes, anchors, 1).session;
+    auto default_input = net->getSessionInputAll(default_session).begin()->second;
+    g_max_input_width = default_input->width();
+    g_max_input_height = default_input->height();
+
+    int listen_fd = create_listen_socket(s->server_address);
+    if (listen_fd < 0) {
+        return;
+    }
+    install_stop_handler();
+    MNN_PRINT("detection server listen on %s, max batch size %d, batch timeout %d ms\n",
+              s->server_address.c_str(), max_batch_size, s->batch_timeout_ms);
+
+    std::thread accept_thread([listen_fd, num_classes, s]() {
+        while (!g_stop.load()) {
+            int fd = accept(listen_fd, nullptr, nullptr);
+            join_connections(false);
+            if (fd < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (!g_stop.load()) {
+                    MNN_ERROR("accept fail: %s\n", strerror(errno));
+                }
+                break;
+            }
+            std::lock_guard<std::mutex> lock(g_connection_mutex);
+            g_connection_threads[fd] = std::thread(handle_connection, fd, num_classes, s);
+        }
+    });
+
+    // batch runner: once a request arrives, wait until the batch is
+    // full or the oldest request reaches timeout, then run together.
+    // only requests with the same input size as the oldest one could
+    // be batched, others are left in queue for following batches
+    auto batch_timeout = std::chrono::milliseconds(s->batch_timeout_ms);
+    long long served_count = 0, batch_count = 0;
+    double total_latency = 0;
+
+    auto same_size = [](const t_pending_request* a, const t_pending_request* b) {
+        return a->input_width == b->input_width && a->input_height == b->input_height;
+    };
+    auto cycle_start = std::chrono::steady_clock::now();
+
+    while (!g_stop.load()) {
+        std::vector<t_pending_request*> batch_requests;
+        {
+            std::unique_lock<std::mutex> lock(g_queue_mutex);
+            if (!g_queue_cond.wait_for(lock, STOP_POLL_INTERVAL, [] { return !g_request_queue.empty(); })) {
+                continue;
+            }
+            auto front = g_request_queue.front();
+            g_queue_cond.wait_until(lock, front->arrive_time + batch_timeout,
+                [max_batch_size, front, &same_size] {
+                    return int(std::count_if(g_request_queue.begin(), g_request_queue.end(),
+                        [front, &same_size](const t_pending_request* r) { return same_size(front, r); })) >= max_batch_size;
+                });
+
+            for (auto iter = g_request_queue.begin(); iter != g_request_queue.end() && int(batch_requests.size()) < max_batch_size; ) {
+                if (same_size(front, *iter)) {
+                    batch_requests.emplace_back(*iter);
+                    iter = g_request_queue.erase(iter);
+                } else {
+                    ++iter;
+                }
+            }
+        }
+
+        int batch_size = batch_requests.size();
+        auto& session = get_cached_session(net.get(), s, session_cache, num_classes, anchors, batch_size,
+                                           batch_requests[0]->input_width, batch_requests[0]->input_height);
+
+        std::vector<t_image_buffer> images;
+        for (auto request : batch_requests) {
+            images.emplace_back(request->image);
+        }
+        std::vector<std::vector<t_prediction>> prediction_nms_lists;
+        auto detect_start = std::chrono::steady_clock::now();
+        detect_batch(net.get(), session.session, session.plan.get(), images, num_classes, prediction_nms_lists, s);
+        auto detect_stop = std::chrono::steady_clock::now();
+
+        // busy ratio is smoothed over batches, with the waiting time
+        // since last batch as idle
+        float busy_ratio = std::chrono::duration<float>(detect_stop - detect_start).count() /
+                           std::max(std::chrono::duration<float>(detect_stop - cycle_start).count(), 1e-6f);
+        g_busy_ratio.store(0.9f * g_busy_ratio.load() + 0.1f * busy_ratio);
+        cycle_start = detect_stop;
+
+        {
+            std::lock_guard<std::mutex> lock(g_queue_mutex);
+            auto finish_time = std::chrono::steady_clock::now();
+            for (int i = 0; i < batch_size; i++) {
+                batch_requests[i]->prediction_nms_list.swap(prediction_nms_lists[i]);
+                batch_requests[i]->done = true;
+                total_latency += std::chrono::duration<double, std::milli>(finish_time - batch_requests[i]->arrive_time).count();
+            }
+            g_done_cond.notify_all();
+        }
+
+        served_count += batch_size;
+        batch_count++;
+        if (batch_count % 100 == 0) {
+            MNN_PRINT("served requests: %lld, average batch size: %lf, average latency: %lf ms\n",
+                      served_count, double(served_count) / batch_count, total_latency / served_count);
+        }
+    }
+
+    // drop the queued requests, and wake up their connections
+    {
+        std::lock_guard<std::mutex> lock(g_queue_mutex);
+        g_runner_stopped = true;
+        g_request_queue.clear();
+        g_done_cond.notify_all();
+    }
+
+    // accept thread is woken up by listen socket shutdown, then the
+    // connections by their socket shutdown
+    shutdown(listen_fd, SHUT_RDWR);
+    accept_thread.join();
+    join_connections(true);
+    close(listen_fd);
+    if (!is_port_address(s->server_address)) {
+        unlink(s->server_address.c_str());
+    }
+    MNN_PRINT("detection server stopped, served requests: %lld\n", served_count);
+    return;
+}
+
+
+void RunShmDetection(Settings* s) {
+    std::vector<std::string> classes;
+    std::vector<std::pair<float, float>> anchors;
+    load_classes_anchors(s, classes, anchors);
+    int num_classes = classes.size();
+    MNN_PRINT("num_classes: %d\n", num_classes);
+
+    std::shared_ptr<Interpreter> net(Interpreter::createFromFile(s->model_name.c_str()));
+    if (net == nullptr) {
+        MNN_ERROR("Can't load model %s\n", s->model_name.c_str());
+        return;
+    }
+    int max_batch_size = std::max(1, std::min(s->max_batch_size, SHM_FRAME_SLOT_NUM));
+    t_session_cache session_cache;
+    get_cached_session(net.get(), s, session_cache, num_classes, anchors, 1);
+
+    // detector owns the rings, producers and result readers open
+    // them by name after they're created
+    t_shm_ring frame_ring, result_ring;
+    std::string frame_ring_name = s->shm_name + "_frames";
+    std::string result_ring_name = s->shm_name + "_results";
+    if (!frame_ring_create(frame_ring, frame_ring_name, SHM_FRAME_SLOT_NUM, SHM_FRAME_MAX_SIZE)) {
+        return;
+    }
+    if (!result_ring_create(result_ring, result_ring_name, SHM_RESULT_SLOT_NUM, SHM_RESULT_MAX_OBJECTS)) {
+        shm_ring_close(frame_ring, true);
+        return;
+    }
+    install_stop_handler();
+    MNN_PRINT("detect frames from shared memory %s, publish result to %s, max batch size %d\n",
+              frame_ring_name.c_str(), result_ring_name.c_str(), max_batch_size);
+
+    auto frame_ring_header = reinterpret_cast<t_frame_ring_header*>(frame_ring.base);
+    size_t max_frame_size = frame_ring_header->slot_size - sizeof(t_frame_slot_header);
+    long long frame_count = 0, skip_count = 0, batch_count = 0;
+    double total_time = 0;
+    int idle_count = 0;
+
+    // frames of every source are tracked (skipped, motion gated)
+    // separately. frame skipping relies on tracker prediction
+    bool track = s->track || s->skip_frames > 1;
+    std::map<uint32_t, Tracker> trackers;
+    std::map<uint32_t, FrameSkipper> skippers;
+    std::map<uint32_t, MotionGate> motion_gates;
+    float busy_ratio = 0;
+    struct timeval cycle_start;
+    gettimeofday(&cycle_start, nullptr);
+
+    while (!g_stop.load()) {
+        // take all the ready frames (up to max batch) as a batch, and
+        // read them in place, without copying out of the ring
+        std::vector<t_frame_slot_header*> frames;
+        std::vector<t_image_buffer> images;
+        for (int i = 0; i < max_batch_size; i++) {
+            auto frame = frame_ring_front(frame_ring, i);
+            if (frame == nullptr) {
+                break;
+            }
+            frames.emplace_back(frame);
+        }
+
+        if (frames.empty()) {
+            // spin for a while, then back off to sleep polling
+            if (++idle_count > 1000) {
+                usleep(200);
+            }
+            continue;
+        }
+        idle_count = 0;
+
+        // every detected frame has a range of images in batch: the
+        // whole frame, or the moving regions with motion gate
+        std::vector<bool> valid_flags, skip_flags;
+        std::vector<int> image_begins;
+        std::vector<std::vector<t_image_rect>> frame_rois(frames.size());
+        std::vector<std::vector<uint8_t>> roi_datas;
+        for (int i = 0; i < int(frames.size()); i++) {
+            auto frame = frames[i];
+            image_begins.emplace_back(images.size());
+            if (frame->width == 0 || frame->height == 0 ||
+                uint64_t(frame->width) * frame->height * 3 > max_frame_size) {
+                MNN_ERROR("Invalid frame %llu shape %ux%u, skip it\n",
+                          (unsigned long long)frame->frame_id, frame->width, frame->height);
+                valid_flags.emplace_back(false);
+                skip_flags.emplace_back(false);
+                continue;
+            }
+            bool skip = false;
+            if (s->skip_frames > 1) {
+                auto& skipper = skippers.emplace(frame->source_id, FrameSkipper(s->skip_frames)).first->second;
+                skip = !skipper.need_detect();
+            }
+            valid_flags.emplace_back(true);
+            skip_flags.emplace_back(skip);
+            if (skip) {
+                continue;
+            }
+            t_image_buffer image;
+            image.data = frame_slot_data(frame);
+            image.width = frame->width;
+            image.height = frame->height;
+            image.channel = 3;
+            if (!s->motion_gate) {
+                images.emplace_back(image);
+                continue;
+            }
+
+            motion_gates[frame->source_id].get_rois(image, frame_rois[i]);
+            for (auto& roi : frame_rois[i]) {
+                if (roi.width == image.width && roi.height == image.height) {
+                    images.emplace_back(image);
+                } else {
+                    roi_datas.emplace_back();
+                    images.emplace_back(crop_image(image, roi, roi_datas.back()));
+                }
+            }
+        }
+        image_begins.emplace_back(images.size());
+
+        struct timeval start_time, stop_time;
+        gettimeofday(&start_time, nullptr);
+
+        // ROIs may exceed max batch, so run in several batches
+        std::vector<std::vector<t_prediction>> prediction_nms_lists;
+        int num_images = images.size();
+        for (int begin = 0; begin < num_images; begin += max_batch_size) {
+            int end = std::min(begin + max_batch_size, num_images);
+            std::vector<t_image_buffer> batch_images(images.begin() + begin, images.begin() + end);
+            auto& session = get_cached_session(net.get(), s, session_cache, num_classes, anchors, end - begin);
+
+            std::vector<std::vector<t_prediction>> batch_prediction_lists;
+            detect_batch(net.get(), session.session, session.plan.get(), batch_images, num_classes, batch_prediction_lists, s);
+            for (auto& prediction_list : batch_prediction_lists) {
+                prediction_nms_lists.emplace_back(std::move(prediction_list));
+            }
+        }
+
+        // busy ratio is smoothed over batches, with the polling time
+        // since last batch as idle
+        gettimeofday(&stop_time, nullptr);
+        float detect_time = get_us(stop_time) - get_us(start_time);
+        busy_ratio = 0.9f * busy_ratio + 0.1f * detect_time / std::max(float(get_us(stop_time) - get_us(cycle_start)), 1.0f);
+        cycle_start = stop_time;
+
+        // publish result in frame order, skipped frame gets tracker
+        // prediction and invalid frame gets empty result
+        std::vector<t_prediction> empty_list;
+        for (int i = 0; i < int(frames.size()); i++) {
+            auto frame = frames[i];
+            if (!valid_flags[i]) {
+                result_ring_publish(result_ring, frame, empty_list);
+            } else if (skip_flags[i]) {
+                std::vector<t_prediction> tracked_list;
+                trackers[frame->source_id].predict(tracked_list);
+                result_ring_publish(result_ring, frame, tracked_list);
+                skip_count++;
+            } else {
+                std::vector<t_prediction> prediction_nms_list;
+                if (s->motion_gate) {
+                    std::vector<std::vector<t_prediction>> roi_prediction_lists(prediction_nms_lists.begin() + image_begins[i],
+                                                                                prediction_nms_lists.begin() + image_begins[i + 1]);
+                    motion_gates[frame->source_id].merge(frame_rois[i], roi_prediction_lists, num_classes,
+                                                         s->iou_threshold, prediction_nms_list);
+                } else {
+                    prediction_nms_list.swap(prediction_nms_lists[image_begins[i]]);
+                }
+
+                if (track) {
+                    auto& tracker = trackers[frame->source_id];
+                    std::vector<t_prediction> tracked_list;
+                    tracker.update(prediction_nms_list, tracked_list);
+                    prediction_nms_list.swap(tracked_list);
+                    if (s->skip_frames > 1) {
+                        skippers.at(frame->source_id).adjust(tracker.get_motion(), busy_ratio);
+                    }
+                }
+                result_ring_publish(result_ring, frame, prediction_nms_list);
+            }
+            frame_ring_pop(frame_ring);
+        }
+
+        gettimeofday(&stop_time, nullptr);
+        total_time += (get_us(stop_time) - get_us(start_time)) / 1000;
+        frame_count += frames.size();
+        batch_count++;
+        if (batch_count % 100 == 0) {
+            MNN_PRINT("detected frames: %lld, skipped frames: %lld, average batch size: %lf, average time: %lf ms per frame\n",
+                      frame_count, skip_count, double(frame_count - skip_count) / batch_count, total_time / frame_count);
+        }
+    }
+
+    // unlink the rings, producers & readers keep their mappings
+    shm_ring_close(result_ring, true);
+    shm_ring_close(frame_ring, true);
+    MNN_PRINT("shared memory detection stopped, detected frames: %lld\n", frame_count);
+    return;
+}
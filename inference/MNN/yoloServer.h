@@ -0,0 +1,49 @@
+//
+//  yoloServer.h
+//  MNN
+//
+//  Wire protocol of the local detection server. A client sends
+//  a t_server_request header followed by data_size bytes image
+//  data, and gets back an image t_result_record followed by the
+//  object t_result_record of every detected box
+//
+
+#ifndef YOLO_DETECTION_YOLO_SERVER_H_
+#define YOLO_DETECTION_YOLO_SERVER_H_
+
+#include <stdint.h>
+#include "resultWriter.h"
+
+
+// image data format of request
+enum RequestFormat {
+    REQUEST_ENCODED = 0,  // jpg/png/bmp file content
+    REQUEST_RGB = 1,      // raw RGB888 frame with width/height
+};
+
+// request header, in host byte order. model input size is multiple
+// of 32, and no larger than the default input size
+typedef struct server_request {
+    char magic[4];        // "YREQ"
+    uint32_t format;      // RequestFormat
+    uint32_t width;       // frame width for REQUEST_RGB
+    uint32_t height;      // frame height for REQUEST_RGB
+    uint32_t data_size;   // bytes of image data after header
+    uint32_t input_width; // model input width for this request, 0 for default
+    uint32_t input_height;// model input height for this request, 0 for default
+}t_server_request;
+
+// max image data size of one request
+#define SERVER_MAX_REQUEST_SIZE (64 * 1024 * 1024)
+
+
+// keep model resident and serve detection requests over Unix
+// domain socket (or localhost TCP port), with concurrent requests
+// dynamically batched by max batch size/max wait time
+void RunServer(Settings* s);
+
+// detect frames from shared memory frame ring in place, and publish
+// result of every frame to shared memory result ring. see shmRing.h
+void RunShmDetection(Settings* s);
+
+#endif  // YOLO_DETECTION_YOLO_SERVER_H_
@@ -0,0 +1,158 @@
+//
+//  yoloTile.cpp
+//  MNN
+//
+//  Tiled inference for large image, with overlapping model-sized
+//  tiles run in batches and merged back with cross-tile NMS
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "MNN/Interpreter.hpp"
+
+#include "yoloDetection.h"
+
+using namespace MNN;
+
+
+// get tile start positions on one dimension. tiles are evenly
+// spread with at least overlap ratio, and the last one is aligned
+// to image border
+static std::vector<int> get_tile_positions(int image_size, int tile_size, float overlap)
+{
+    std::vector<int> positions;
+    if (image_size <= tile_size) {
+        positions.emplace_back(0);
+        return positions;
+    }
+
+    int step = std::max(1, int(tile_size * (1.0f - overlap)));
+    int tile_num = int(ceil(float(image_size - tile_size) / step)) + 1;
+    for (int i = 0; i < tile_num; i++) {
+        positions.emplace_back(int(round(float(i) * (image_size - tile_size) / (tile_num - 1))));
+    }
+    return positions;
+}
+
+
+static std::vector<t_image_rect> get_tile_rects(int image_width, int image_height, int tile_width, int tile_height, float overlap)
+{
+    std::vector<t_image_rect> tile_rects;
+
+    for (auto y : get_tile_positions(image_height, tile_height, overlap)) {
+        for (auto x : get_tile_positions(image_width, tile_width, overlap)) {
+            t_image_rect rect;
+            rect.x = x;
+            rect.y = y;
+            rect.width = std::min(tile_width, image_width);
+            rect.height = std::min(tile_height, image_height);
+            tile_rects.emplace_back(rect);
+        }
+    }
+    return tile_rects;
+}
+
+
+t_image_buffer crop_image(const t_image_buffer& image, const t_image_rect& rect, std::vector<uint8_t>& data)
+{
+    int row_size = rect.width * image.channel;
+    data.resize(rect.height * row_size);
+    for (int h = 0; h < rect.height; h++) {
+        memcpy(data.data() + h * row_size,
+               image.data + ((rect.y + h) * image.width + rect.x) * image.channel, row_size);
+    }
+
+    t_image_buffer crop;
+    crop.data = data.data();
+    crop.width = rect.width;
+    crop.height = rect.height;
+    crop.channel = image.channel;
+    return crop;
+}
+
+
+void detect_image_tiled(const std::vector<t_detect_worker*>& workers, const t_image_buffer& image,
+                        const int num_classes, const std::vector<std::pair<float, float>>& anchors,
+                        std::vector<t_prediction>& prediction_nms_list, Settings* s)
+{
+    // tile is model-sized, so tile content is fed to model without
+    // downscale, and small objects are kept
+    auto default_session = get_cached_session(workers[0]->net.get(), s, workers[0]->session_cache, num_classes, anchors, 1).session;
+    auto image_input = workers[0]->net->getSessionInputAll(default_session).begin()->second;
+    int tile_width = image_input->width();
+    int tile_height = image_input->height();
+
+    std::vector<t_image_rect> tile_rects = get_tile_rects(image.width, image.height, tile_width, tile_height, s->tile_overlap);
+
+    // crop tiles from origin image. the whole image is also appended
+    // as the last one, to keep large objects across tiles
+    int num_tiles = tile_rects.size();
+    std::vector<std::vector<uint8_t>> tile_datas(num_tiles);
+    std::vector<t_image_buffer> tile_images;
+    for (int i = 0; i < num_tiles; i++) {
+        tile_images.emplace_back(crop_image(image, tile_rects[i], tile_datas[i]));
+    }
+    if (num_tiles > 1) {
+        tile_images.emplace_back(image);
+    }
+
+    // split tiles into batches, and run the batches on worker sessions
+    int num_images = tile_images.size();
+    int max_batch_size = std::max(1, s->max_batch_size);
+    int num_batches = (num_images + max_batch_size - 1) / max_batch_size;
+    std::vector<std::vector<t_prediction>> tile_prediction_lists(num_images);
+    std::atomic<int> next_batch(0);
+
+    auto worker = [&](t_detect_worker* detect_worker) {
+        int batch_index;
+        while ((batch_index = next_batch++) < num_batches) {
+            int begin = batch_index * max_batch_size;
+            int end = std::min(begin + max_batch_size, num_images);
+
+            std::vector<t_image_buffer> batch_images(tile_images.begin() + begin, tile_images.begin() + end);
+            auto& session = get_cached_session(detect_worker->net.get(), s, detect_worker->session_cache, num_classes, anchors, end - begin);
+
+            std::vector<std::vector<t_prediction>> prediction_nms_lists;
+            detect_batch(detect_worker->net.get(), session.session, session.plan.get(), batch_images, num_classes, prediction_nms_lists, s);
+            for (int i = begin; i < end; i++) {
+                tile_prediction_lists[i].swap(prediction_nms_lists[i - begin]);
+            }
+        }
+    };
+
+    int num_workers = std::min(int(workers.size()), num_batches);
+    if (num_workers <= 1) {
+        worker(workers[0]);
+    } else {
+        std::vector<std::thread> threads;
+        for (int i = 0; i < num_workers; i++) {
+            threads.emplace_back(worker, workers[i]);
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    // offset tile boxes back to origin image coordinate, and merge
+    // duplicate boxes on tile seams with NMS
+    std::vector<t_prediction> prediction_list;
+    for (int i = 0; i < num_images; i++) {
+        for (auto prediction : tile_prediction_lists[i]) {
+            if (i < num_tiles) {
+                prediction.x += tile_rects[i].x;
+                prediction.y += tile_rects[i].y;
+            }
+            prediction_list.emplace_back(prediction);
+        }
+    }
+    nms_boxes(prediction_list, prediction_nms_list, num_classes, s->iou_threshold);
+
+    return;
+}
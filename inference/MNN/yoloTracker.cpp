@@ -0,0 +1,410 @@
+//
+//  yoloTracker.cpp
+//  MNN
+//
+//  Multi-object tracker on detection result, with SORT style
+//  Kalman filter and ByteTrack style two-stage greedy IoU matching,
+//  and adaptive frame skipping on it for video stream
+//
+
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <tuple>
+#include <vector>
+
+#include "yoloTracker.h"
+
+
+// measurement (cx, cy, area, ratio) from prediction box
+static void box_to_measurement(const t_prediction& box, float z[4])
+{
+    z[0] = box.x + box.width / 2;
+    z[1] = box.y + box.height / 2;
+    z[2] = box.width * box.height;
+    z[3] = box.width / std::max(box.height, 1e-6f);
+    return;
+}
+
+
+static void kalman_init(t_track& track, const t_prediction& box)
+{
+    // initial covariance has large uncertainty on unobserved velocity
+    const float P_diag[7] = {10, 10, 10, 10, 1e4, 1e4, 1e4};
+
+    memset(track.x, 0, sizeof(track.x));
+    memset(track.P, 0, sizeof(track.P));
+    box_to_measurement(box, track.x);
+    for (int i = 0; i < 7; i++) {
+        track.P[i][i] = P_diag[i];
+    }
+    return;
+}
+
+
+static void kalman_predict(t_track& track)
+{
+    // process noise
+    const float Q_diag[7] = {1, 1, 1, 1, 0.01f, 0.01f, 0.0001f};
+
+    // x = F * x, F adds velocity to (cx, cy, area)
+    if (track.x[2] + track.x[6] <= 0) {
+        track.x[6] = 0;
+    }
+    for (int i = 0; i < 3; i++) {
+        track.x[i] += track.x[i + 4];
+    }
+
+    // P = F * P * F^T + Q
+    float FP[7][7];
+    for (int i = 0; i < 7; i++) {
+        for (int j = 0; j < 7; j++) {
+            FP[i][j] = track.P[i][j] + ((i < 3) ? track.P[i + 4][j] : 0);
+        }
+    }
+    for (int i = 0; i < 7; i++) {
+        for (int j = 0; j < 7; j++) {
+            track.P[i][j] = FP[i][j] + ((j < 3) ? FP[i][j + 4] : 0);
+        }
+        track.P[i][i] += Q_diag[i];
+    }
+    return;
+}
+
+
+// invert 4x4 matrix with Gauss-Jordan elimination
+static bool invert_4x4(const float m[4][4], float inv[4][4])
+{
+    float a[4][8];
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            a[i][j] = m[i][j];
+            a[i][j + 4] = (i == j) ? 1 : 0;
+        }
+    }
+
+    for (int c = 0; c < 4; c++) {
+        int pivot = c;
+        for (int r = c + 1; r < 4; r++) {
+            if (fabs(a[r][c]) > fabs(a[pivot][c])) {
+                pivot = r;
+            }
+        }
+        if (fabs(a[pivot][c]) < 1e-12f) {
+            return false;
+        }
+        if (pivot != c) {
+            for (int j = 0; j < 8; j++) {
+                std::swap(a[c][j], a[pivot][j]);
+            }
+        }
+
+        float scale = 1.0f / a[c][c];
+        for (int j = 0; j < 8; j++) {
+            a[c][j] *= scale;
+        }
+        for (int r = 0; r < 4; r++) {
+            if (r != c && a[r][c] != 0) {
+                float factor = a[r][c];
+                for (int j = 0; j < 8; j++) {
+                    a[r][j] -= factor * a[c][j];
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            inv[i][j] = a[i][j + 4];
+        }
+    }
+    return true;
+}
+
+
+static void kalman_update(t_track& track, const t_prediction& box)
+{
+    // measurement noise, area & ratio are less reliable
+    const float R_diag[4] = {1, 1, 10, 10};
+
+    float z[4];
+    box_to_measurement(box, z);
+
+    // S = H * P * H^T + R, H picks the first 4 state
+    float S[4][4], S_inv[4][4];
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            S[i][j] = track.P[i][j] + ((i == j) ? R_diag[i] : 0);
+        }
+    }
+    if (!invert_4x4(S, S_inv)) {
+        return;
+    }
+
+    // K = P * H^T * S^-1
+    float K[7][4];
+    for (int i = 0; i < 7; i++) {
+        for (int j = 0; j < 4; j++) {
+            float sum = 0;
+            for (int k = 0; k < 4; k++) {
+                sum += track.P[i][k] * S_inv[k][j];
+            }
+            K[i][j] = sum;
+        }
+    }
+
+    // x = x + K * (z - H * x)
+    float y[4];
+    for (int i = 0; i < 4; i++) {
+        y[i] = z[i] - track.x[i];
+    }
+    for (int i = 0; i < 7; i++) {
+        for (int k = 0; k < 4; k++) {
+            track.x[i] += K[i][k] * y[k];
+        }
+    }
+
+    // P = (I - K * H) * P
+    float HP[4][7];
+    memcpy(HP, track.P, sizeof(HP));
+    for (int i = 0; i < 7; i++) {
+        for (int j = 0; j < 7; j++) {
+            float sum = 0;
+            for (int k = 0; k < 4; k++) {
+                sum += K[i][k] * HP[k][j];
+            }
+            track.P[i][j] -= sum;
+        }
+    }
+    return;
+}
+
+
+Tracker::Tracker(float iou_threshold, float high_threshold, int max_age, int min_hits)
+    : mIouThreshold(iou_threshold), mHighThreshold(high_threshold), mMaxAge(max_age), mMinHits(min_hits),
+      mFrameCount(0), mNextId(0)
+{
+}
+
+
+t_prediction Tracker::get_track_box(const t_track& track)
+{
+    t_prediction box;
+    float area = std::max(track.x[2], 0.0f);
+    float ratio = std::max(track.x[3], 0.0f);
+
+    box.width = sqrt(area * ratio);
+    box.height = (box.width > 0) ? area / box.width : 0;
+    box.x = track.x[0] - box.width / 2;
+    box.y = track.x[1] - box.height / 2;
+    box.confidence = track.confidence;
+    box.class_index = track.class_index;
+    box.track_id = track.id;
+    return box;
+}
+
+
+void Tracker::predict_tracks()
+{
+    for (auto& track : mTracks) {
+        kalman_predict(track);
+        track.time_since_update++;
+    }
+    return;
+}
+
+
+// greedy matching: pairs of same class with IoU above threshold are
+// picked in IoU descend order. matched tracks are removed from
+// track_indexes, so the rest could go to next matching stage
+void Tracker::match(const std::vector<t_prediction>& detections, const std::vector<int>& detection_indexes,
+                    std::vector<int>& track_indexes, std::vector<int>& unmatched_detections,
+                    std::vector<std::pair<int, int>>& matches)
+{
+    std::vector<t_prediction> track_boxes;
+    for (auto t : track_indexes) {
+        track_boxes.emplace_back(get_track_box(mTracks[t]));
+    }
+
+    std::vector<std::tuple<float, int, int>> candidates;
+    for (int d = 0; d < detection_indexes.size(); d++) {
+        auto& detection = detections[detection_indexes[d]];
+        for (int t = 0; t < track_boxes.size(); t++) {
+            if (track_boxes[t].class_index != detection.class_index) {
+                continue;
+            }
+            float iou = get_iou(detection, track_boxes[t]);
+            if (iou >= mIouThreshold) {
+                candidates.emplace_back(std::make_tuple(iou, d, t));
+            }
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(),
+              [](const std::tuple<float, int, int>& a, const std::tuple<float, int, int>& b) {
+                  return std::get<0>(a) > std::get<0>(b);
+              });
+
+    std::vector<bool> detection_used(detection_indexes.size(), false);
+    std::vector<bool> track_used(track_indexes.size(), false);
+    for (auto& candidate : candidates) {
+        int d = std::get<1>(candidate);
+        int t = std::get<2>(candidate);
+        if (detection_used[d] || track_used[t]) {
+            continue;
+        }
+        detection_used[d] = true;
+        track_used[t] = true;
+        matches.emplace_back(std::make_pair(detection_indexes[d], track_indexes[t]));
+    }
+
+    for (int d = 0; d < detection_indexes.size(); d++) {
+        if (!detection_used[d]) {
+            unmatched_detections.emplace_back(detection_indexes[d]);
+        }
+    }
+    std::vector<int> unmatched_tracks;
+    for (int t = 0; t < track_indexes.size(); t++) {
+        if (!track_used[t]) {
+            unmatched_tracks.emplace_back(track_indexes[t]);
+        }
+    }
+    track_indexes.swap(unmatched_tracks);
+    return;
+}
+
+
+void Tracker::update(const std::vector<t_prediction>& detections, std::vector<t_prediction>& tracked_list)
+{
+    mFrameCount++;
+    predict_tracks();
+
+    // split detections by confidence
+    std::vector<int> high_detections, low_detections;
+    for (int i = 0; i < detections.size(); i++) {
+        if (detections[i].confidence >= mHighThreshold) {
+            high_detections.emplace_back(i);
+        } else {
+            low_detections.emplace_back(i);
+        }
+    }
+
+    // 1st stage: high confidence detections with all tracks
+    // 2nd stage: low confidence detections with the rest tracks,
+    //            which recovers occluded/blurred objects
+    std::vector<int> track_indexes;
+    for (int i = 0; i < mTracks.size(); i++) {
+        track_indexes.emplace_back(i);
+    }
+    std::vector<std::pair<int, int>> matches;
+    std::vector<int> unmatched_high, unmatched_low;
+    match(detections, high_detections, track_indexes, unmatched_high, matches);
+    match(detections, low_detections, track_indexes, unmatched_low, matches);
+
+    for (auto& m : matches) {
+        auto& track = mTracks[m.second];
+        kalman_update(track, detections[m.first]);
+        track.confidence = detections[m.first].confidence;
+        track.hits++;
+        track.time_since_update = 0;
+    }
+
+    // remove tracks lost for too long
+    mTracks.erase(std::remove_if(mTracks.begin(), mTracks.end(),
+                                 [this](const t_track& track) { return track.time_since_update > mMaxAge; }),
+                  mTracks.end());
+
+    // unmatched high confidence detections start new tracks
+    for (auto d : unmatched_high) {
+        t_track track;
+        track.id = mNextId++;
+        track.class_index = detections[d].class_index;
+        track.confidence = detections[d].confidence;
+        track.hits = 1;
+        track.time_since_update = 0;
+        track.visible = false;
+        kalman_init(track, detections[d]);
+        mTracks.emplace_back(track);
+    }
+
+    // output tracks updated in this frame, and confirmed by enough
+    // hits (or at the beginning of the stream)
+    for (auto& track : mTracks) {
+        track.visible = (track.time_since_update == 0 && (track.hits >= mMinHits || mFrameCount <= mMinHits));
+        if (track.visible) {
+            tracked_list.emplace_back(get_track_box(track));
+        }
+    }
+
+    return;
+}
+
+
+void Tracker::predict(std::vector<t_prediction>& tracked_list)
+{
+    mFrameCount++;
+    predict_tracks();
+
+    for (auto& track : mTracks) {
+        if (track.visible) {
+            tracked_list.emplace_back(get_track_box(track));
+        }
+    }
+    return;
+}
+
+
+float Tracker::get_motion() const
+{
+    // objects may come in at any time without a track, and a new track
+    // has no reliable velocity before confirmed
+    float motion = -1;
+    for (auto& track : mTracks) {
+        if (track.time_since_update == 0 && track.hits < mMinHits) {
+            return -1;
+        }
+        if (track.visible && track.x[2] > 0) {
+            motion = std::max(motion, float(sqrt((track.x[4] * track.x[4] + track.x[5] * track.x[5]) / track.x[2])));
+        }
+    }
+    return motion;
+}
+
+
+FrameSkipper::FrameSkipper(int max_interval, float max_drift)
+    : mMaxInterval(std::max(1, max_interval)), mMaxDrift(max_drift), mInterval(1), mLoadInterval(1),
+      mSkipCount(0)
+{
+}
+
+
+bool FrameSkipper::need_detect()
+{
+    if (mSkipCount + 1 >= mInterval) {
+        mSkipCount = 0;
+        return true;
+    }
+    mSkipCount++;
+    return false;
+}
+
+
+void FrameSkipper::adjust(float motion, float busy_ratio)
+{
+    // load part moves one step per detected frame, to avoid oscillation
+    if (busy_ratio > 0.9f) {
+        mLoadInterval = std::min(mLoadInterval + 1, mMaxInterval);
+    } else if (busy_ratio < 0.6f) {
+        mLoadInterval = std::max(mLoadInterval - 1, 1);
+    }
+
+    int motion_interval = mMaxInterval;
+    if (motion < 0) {
+        // unknown motion, detect every frame until tracks are confirmed
+        motion_interval = 1;
+    } else if (motion * mMaxInterval > mMaxDrift) {
+        motion_interval = std::max(1, int(mMaxDrift / motion));
+    }
+
+    mInterval = std::min(std::max(motion_interval, mLoadInterval), mMaxInterval);
+    return;
+}
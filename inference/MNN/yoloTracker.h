@@ -0,0 +1,97 @@
+//
+//  yoloTracker.h
+//  MNN
+//
+//  Multi-object tracker on detection result, with SORT style
+//  Kalman filter and ByteTrack style two-stage greedy IoU matching,
+//  and adaptive frame skipping on it for video stream
+//
+
+#ifndef YOLO_DETECTION_YOLO_TRACKER_H_
+#define YOLO_DETECTION_YOLO_TRACKER_H_
+
+#include <vector>
+#include "yoloDetection.h"
+
+
+// Kalman filter track with constant velocity model on
+// state (cx, cy, area, ratio, v_cx, v_cy, v_area)
+typedef struct track {
+    int id;
+    int class_index;
+    float confidence;
+    float x[7];                 // state
+    float P[7][7];              // state covariance
+    int hits;                   // matched detection count
+    int time_since_update;      // frames since last matched
+    bool visible;               // output in last update
+}t_track;
+
+
+class Tracker {
+public:
+    // iou_threshold: min IoU for detection-track matching
+    // high_threshold: detections below it only match existing tracks
+    // max_age: frames to keep a lost track before deleting it
+    // min_hits: matched times to confirm a new track for output
+    Tracker(float iou_threshold = 0.3f, float high_threshold = 0.5f, int max_age = 30, int min_hits = 3);
+
+    // update tracks with detection result of a new frame, and get
+    // boxes of the confirmed tracks with track_id filled
+    void update(const std::vector<t_prediction>& detections, std::vector<t_prediction>& tracked_list);
+
+    // propagate tracks to a new frame without detection, and get the
+    // predicted boxes of the tracks output in last update
+    void predict(std::vector<t_prediction>& tracked_list);
+
+    // scene motion: max center speed of output tracks, in box size
+    // per frame. -1 for unknown motion, when there is no output track
+    // or a new track is not confirmed yet
+    float get_motion() const;
+
+private:
+    void predict_tracks();
+    void match(const std::vector<t_prediction>& detections, const std::vector<int>& detection_indexes,
+               std::vector<int>& track_indexes, std::vector<int>& unmatched_detections,
+               std::vector<std::pair<int, int>>& matches);
+    t_prediction get_track_box(const t_track& track);
+
+    float mIouThreshold;
+    float mHighThreshold;
+    int mMaxAge;
+    int mMinHits;
+    int mFrameCount;
+    int mNextId;
+    std::vector<t_track> mTracks;
+};
+
+
+// decide which frames of a video stream run full detection. the
+// detection interval is adjusted on every detected frame by:
+//   scene motion: the interval that tracks drift less than max_drift
+//                 box size with motion model only, or 1 for unknown
+//                 motion (no tracks, or new tracks to confirm)
+//   detector load: increased while detector is busy (busy ratio above
+//                  0.9), and decreased when it has spare time (below 0.6)
+// and the larger one is used, capped by max_interval
+class FrameSkipper {
+public:
+    FrameSkipper(int max_interval, float max_drift = 0.25f);
+
+    // check if the coming frame needs full detection
+    bool need_detect();
+
+    // adjust interval after a detected frame
+    void adjust(float motion, float busy_ratio);
+
+    int interval() const { return mInterval; }
+
+private:
+    int mMaxInterval;
+    float mMaxDrift;
+    int mInterval;
+    int mLoadInterval;
+    int mSkipCount;
+};
+
+#endif  // YOLO_DETECTION_YOLO_TRACKER_H_
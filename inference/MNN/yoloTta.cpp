@@ -0,0 +1,179 @@
+//
+//  yoloTta.cpp
+//  MNN
+//
+//  Test-time augmentation (horizontal flip & multi-scale) with
+//  weighted box fusion or NMS merge
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "MNN/Interpreter.hpp"
+
+#include "yoloDetection.h"
+
+using namespace MNN;
+
+
+bool parse_tta(const std::string& str, Settings* s)
+{
+    // TTA variants should be like "flip,320,608x352"
+    std::stringstream ss(str);
+    std::string variant;
+    while (std::getline(ss, variant, ',')) {
+        if (variant == "flip") {
+            s->tta_flip = true;
+        } else {
+            int width, height;
+            if (!parse_image_size(variant, width, height)) {
+                return false;
+            }
+            s->tta_sizes.emplace_back(std::make_pair(width, height));
+        }
+    }
+    return true;
+}
+
+
+// descend order sort for prediction records
+static bool compare_conf_descend(const t_prediction& lpred, const t_prediction& rpred)
+{
+    return lpred.confidence > rpred.confidence;
+}
+
+
+// weighted box fusion: boxes of all variants are clustered by IoU,
+// and every cluster is fused into one box with confidence weighted
+// coordinates. confidence is averaged, and scaled down if only some
+// of the variants predict the box
+void weighted_box_fusion(const std::vector<std::vector<t_prediction>>& prediction_lists, const int num_classes,
+                         const float iou_threshold, std::vector<t_prediction>& prediction_fused_list)
+{
+    int num_variants = prediction_lists.size();
+
+    for (int i = 0; i < num_classes; i++) {
+        std::vector<t_prediction> class_pred_list;
+        for (auto& prediction_list : prediction_lists) {
+            for (auto& prediction : prediction_list) {
+                if (prediction.class_index == i) {
+                    class_pred_list.emplace_back(prediction);
+                }
+            }
+        }
+        if (class_pred_list.empty()) {
+            continue;
+        }
+        std::sort(class_pred_list.begin(), class_pred_list.end(), compare_conf_descend);
+
+        std::vector<std::vector<t_prediction>> clusters;
+        std::vector<t_prediction> fused_list;
+        for (auto& prediction : class_pred_list) {
+            // match the fused box with max IoU
+            int match_index = -1;
+            float max_iou = iou_threshold;
+            for (int j = 0; j < fused_list.size(); j++) {
+                float iou = get_iou(fused_list[j], prediction);
+                if (iou > max_iou) {
+                    max_iou = iou;
+                    match_index = j;
+                }
+            }
+
+            if (match_index < 0) {
+                clusters.emplace_back(std::vector<t_prediction>(1, prediction));
+                fused_list.emplace_back(prediction);
+                continue;
+            }
+
+            // update fused box with the cluster
+            auto& cluster = clusters[match_index];
+            cluster.emplace_back(prediction);
+
+            float conf_sum = 0, x = 0, y = 0, width = 0, height = 0;
+            for (auto& box : cluster) {
+                conf_sum += box.confidence;
+                x += box.confidence * box.x;
+                y += box.confidence * box.y;
+                width += box.confidence * box.width;
+                height += box.confidence * box.height;
+            }
+            auto& fused = fused_list[match_index];
+            fused.x = x / conf_sum;
+            fused.y = y / conf_sum;
+            fused.width = width / conf_sum;
+            fused.height = height / conf_sum;
+            fused.confidence = conf_sum / cluster.size();
+        }
+
+        for (int j = 0; j < fused_list.size(); j++) {
+            int num_boxes = std::min(int(clusters[j].size()), num_variants);
+            fused_list[j].confidence = fused_list[j].confidence * num_boxes / num_variants;
+            prediction_fused_list.emplace_back(fused_list[j]);
+        }
+    }
+
+    return;
+}
+
+
+void detect_image_tta(t_detect_worker* worker, const t_image_buffer& image,
+                      const int num_classes, const std::vector<std::pair<float, float>>& anchors,
+                      std::vector<t_prediction>& prediction_nms_list, Settings* s)
+{
+    // horizontal flip variant is made from the decoded image once,
+    // and shared by all the scales, so the extra cost is inference
+    std::vector<t_image_buffer> images(1, image);
+    std::vector<uint8_t> flip_data;
+    if (s->tta_flip) {
+        flip_data.resize(image.width * image.height * image.channel);
+        for (int h = 0; h < image.height; h++) {
+            const uint8_t* src_row = image.data + h * image.width * image.channel;
+            uint8_t* dst_row = flip_data.data() + h * image.width * image.channel;
+            for (int w = 0; w < image.width; w++) {
+                memcpy(dst_row + (image.width - 1 - w) * image.channel, src_row + w * image.channel, image.channel);
+            }
+        }
+        t_image_buffer flip_image = image;
+        flip_image.data = flip_data.data();
+        images.emplace_back(flip_image);
+    }
+
+    // model default input size is always used, and every scale runs
+    // origin & flip image as one batch on the cached session
+    std::vector<std::pair<int, int>> input_sizes(1, std::make_pair(0, 0));
+    input_sizes.insert(input_sizes.end(), s->tta_sizes.begin(), s->tta_sizes.end());
+
+    std::vector<std::vector<t_prediction>> variant_lists;
+    for (auto& input_size : input_sizes) {
+        auto& session = get_cached_session(worker->net.get(), s, worker->session_cache, num_classes, anchors,
+                                           images.size(), input_size.first, input_size.second);
+
+        std::vector<std::vector<t_prediction>> prediction_nms_lists;
+        detect_batch(worker->net.get(), session.session, session.plan.get(), images, num_classes, prediction_nms_lists, s);
+
+        // mirror the boxes of flip image back
+        if (s->tta_flip) {
+            for (auto& prediction : prediction_nms_lists[1]) {
+                prediction.x = image.width - prediction.x - prediction.width;
+            }
+        }
+        variant_lists.insert(variant_lists.end(), prediction_nms_lists.begin(), prediction_nms_lists.end());
+    }
+
+    if (s->tta_merge == "nms") {
+        std::vector<t_prediction> prediction_list;
+        for (auto& variant_list : variant_lists) {
+            prediction_list.insert(prediction_list.end(), variant_list.begin(), variant_list.end());
+        }
+        nms_boxes(prediction_list, prediction_nms_list, num_classes, s->iou_threshold);
+    } else {
+        weighted_box_fusion(variant_lists, num_classes, s->wbf_iou_threshold, prediction_nms_list);
+    }
+
+    return;
+}
@@ -0,0 +1,176 @@
+//
+//  yoloVideo.cpp
+//  MNN
+//
+//  Frame by frame detection on uncompressed video file, to
+//  benchmark sustained stream throughput & per-frame latency
+//
+
+#include <stdio.h>
+#include <sys/time.h>
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "MNN/Interpreter.hpp"
+
+#include "yoloDetection.h"
+#include "resultWriter.h"
+#include "videoReader.h"
+#include "yoloTracker.h"
+#include "yoloMotion.h"
+
+using namespace MNN;
+
+
+void RunVideoDetection(Settings* s) {
+    // get classes labels & anchor value
+    std::vector<std::string> classes;
+    std::vector<std::pair<float, float>> anchors;
+    load_classes_anchors(s, classes, anchors);
+    int num_classes = classes.size();
+    MNN_PRINT("num_classes: %d\n", num_classes);
+
+    VideoReader video_reader;
+    if (!video_reader.open(s->video_name, s->video_format)) {
+        return;
+    }
+    int num_frames = video_reader.frame_count();
+    MNN_PRINT("video %s: %dx%d, %d frames, %lf fps\n", s->video_name.c_str(),
+              video_reader.width(), video_reader.height(), num_frames, video_reader.fps());
+    MNN_PRINT("backend config: threads %d, precision %s, power %s, memory %s\n", s->number_of_threads,
+              s->precision.c_str(), s->power.c_str(), s->memory.c_str());
+
+    // frames are detected in order on one worker (intra-op threads
+    // from --threads), as a live stream
+    t_detect_worker worker;
+    worker.net.reset(Interpreter::createFromFile(s->model_name.c_str()));
+    if (worker.net == nullptr) {
+        MNN_ERROR("Can't load model %s\n", s->model_name.c_str());
+        return;
+    }
+    std::vector<t_detect_worker*> workers(1, &worker);
+
+    std::unique_ptr<ResultWriter> result_writer;
+    FILE* result_file = nullptr;
+    if (!s->result_file_name.empty()) {
+        open_result_writer(s->result_file_name, s->result_format, classes, result_writer, result_file);
+    }
+
+    // stream features work like on a shm source. detector busy ratio
+    // is the detection time over frame period of video fps
+    bool track = s->track || s->skip_frames > 1;
+    Tracker tracker;
+    FrameSkipper skipper(s->skip_frames);
+    MotionGate motion_gate;
+    double frame_period_ms = 1000 / video_reader.fps();
+
+    // warm up sessions on the first frame
+    t_image_buffer image;
+    std::vector<t_prediction> prediction_nms_list;
+    video_reader.read_frame(0, image);
+    for (int i = 0; i < s->number_of_warmup_runs; i++) {
+        prediction_nms_list.clear();
+        detect_image_workers(workers, image, num_classes, anchors, prediction_nms_list, s);
+    }
+
+    // with motion gate, sessions of ROI batches (up to MOTION_MAX_ROIS)
+    // are also created & warmed up here, to keep them out of latency
+    if (s->motion_gate) {
+        t_image_rect roi = {0, 0, std::min(MOTION_MIN_ROI_SIZE, image.width), std::min(MOTION_MIN_ROI_SIZE, image.height)};
+        std::vector<uint8_t> roi_data;
+        t_image_buffer roi_image = crop_image(image, roi, roi_data);
+        for (int batch = 1; batch <= MOTION_MAX_ROIS; batch++) {
+            std::vector<t_image_buffer> roi_images(batch, roi_image);
+            std::vector<std::vector<t_prediction>> roi_prediction_lists;
+            auto& session = get_cached_session(worker.net.get(), s, worker.session_cache, num_classes, anchors, batch);
+            for (int i = 0; i < s->number_of_warmup_runs; i++) {
+                detect_batch(worker.net.get(), session.session, session.plan.get(), roi_images, num_classes, roi_prediction_lists, s);
+            }
+        }
+    }
+
+    struct timeval start_time, stop_time, frame_start_time, frame_stop_time;
+    std::vector<double> latencies;
+    long long num_detections = 0;
+    int skip_count = 0;
+
+    gettimeofday(&start_time, nullptr);
+    for (int frame_index = 0; frame_index < num_frames; frame_index++) {
+        gettimeofday(&frame_start_time, nullptr);
+        prediction_nms_list.clear();
+
+        bool detected = (s->skip_frames <= 1 || skipper.need_detect());
+        if (!detected) {
+            tracker.predict(prediction_nms_list);
+            skip_count++;
+        } else {
+            video_reader.read_frame(frame_index, image);
+
+            if (!s->motion_gate) {
+                detect_image_workers(workers, image, num_classes, anchors, prediction_nms_list, s);
+            } else {
+                // whole frame goes the normal path, and moving regions
+                // (at most MOTION_MAX_ROIS) are detected as one batch
+                std::vector<t_image_rect> rois;
+                motion_gate.get_rois(image, rois);
+
+                std::vector<std::vector<t_prediction>> roi_prediction_lists;
+                if (rois.size() == 1 && rois[0].width == image.width && rois[0].height == image.height) {
+                    roi_prediction_lists.resize(1);
+                    detect_image_workers(workers, image, num_classes, anchors, roi_prediction_lists[0], s);
+                } else if (!rois.empty()) {
+                    std::vector<std::vector<uint8_t>> roi_datas(rois.size());
+                    std::vector<t_image_buffer> roi_images;
+                    for (int i = 0; i < rois.size(); i++) {
+                        roi_images.emplace_back(crop_image(image, rois[i], roi_datas[i]));
+                    }
+                    auto& session = get_cached_session(worker.net.get(), s, worker.session_cache, num_classes, anchors, roi_images.size());
+                    detect_batch(worker.net.get(), session.session, session.plan.get(), roi_images, num_classes, roi_prediction_lists, s);
+                }
+                motion_gate.merge(rois, roi_prediction_lists, num_classes, s->iou_threshold, prediction_nms_list);
+            }
+
+            if (track) {
+                std::vector<t_prediction> tracked_list;
+                tracker.update(prediction_nms_list, tracked_list);
+                prediction_nms_list.swap(tracked_list);
+            }
+        }
+
+        gettimeofday(&frame_stop_time, nullptr);
+        double latency = (get_us(frame_stop_time) - get_us(frame_start_time)) / 1000;
+        latencies.emplace_back(latency);
+        if (detected && s->skip_frames > 1) {
+            skipper.adjust(tracker.get_motion(), latency / frame_period_ms);
+        }
+
+        if (result_writer) {
+            result_writer->write(s->video_name, frame_index, video_reader.width(), video_reader.height(), prediction_nms_list);
+        }
+        num_detections += prediction_nms_list.size();
+    }
+    gettimeofday(&stop_time, nullptr);
+
+    close_result_writer(result_writer, result_file);
+
+    // sustained throughput, and latency distribution of all frames
+    double total_ms = (get_us(stop_time) - get_us(start_time)) / 1000;
+    std::vector<double> sorted_latencies(latencies);
+    std::sort(sorted_latencies.begin(), sorted_latencies.end());
+    auto percentile = [&sorted_latencies](double p) {
+        return sorted_latencies[std::min(int(p * sorted_latencies.size()), int(sorted_latencies.size()) - 1)];
+    };
+    double mean_latency = 0;
+    for (auto latency : latencies) {
+        mean_latency += latency;
+    }
+    mean_latency /= latencies.size();
+
+    MNN_PRINT("video detection: %d frames (%d skipped) in %lf ms, sustained %lf fps (video %lf fps), %lld objects detected\n",
+              num_frames, skip_count, total_ms, num_frames * 1000 / total_ms, video_reader.fps(), num_detections);
+    MNN_PRINT("frame latency: mean %lf ms, p50 %lf ms, p90 %lf ms, p99 %lf ms, max %lf ms\n",
+              mean_latency, percentile(0.5), percentile(0.9), percentile(0.99), sorted_latencies.back());
+    return;
+}
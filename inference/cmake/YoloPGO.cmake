@@ -0,0 +1,86 @@
+#### profile guided optimization (PGO) & link time optimization (LTO)
+#### for the yoloDetection apps
+####
+#### YOLO_PGO=GENERATE  build instrumented binary, which writes profile
+####                    to YOLO_PGO_DIR when run
+#### YOLO_PGO=USE       rebuild with the collected profile, plus LTO
+#### YOLO_LTO=ON        LTO only, without profile
+####
+#### GCC keys profile files by object path, so GENERATE & USE should
+#### be built in the same build dir. "make pgo_build" does the whole
+#### flow (instrumented build -> training run -> optimized build) in
+#### <build>/pgo with YoloPGOBuild.cmake, when YOLO_PGO_MODEL is set
+
+set(YOLO_PGO "OFF" CACHE STRING "profile guided optimization mode: OFF, GENERATE or USE")
+set_property(CACHE YOLO_PGO PROPERTY STRINGS OFF GENERATE USE)
+set(YOLO_PGO_DIR "${CMAKE_BINARY_DIR}/pgo-profile" CACHE PATH "profile data dir of PGO")
+option(YOLO_LTO "link time optimization" OFF)
+
+#### training workload of "make pgo_build": example images over the
+#### detector loop, with model/anchors/classes of the app
+set(YOLO_PGO_MODEL "" CACHE FILEPATH "model file for PGO training run")
+set(YOLO_PGO_ANCHORS "${CMAKE_CURRENT_LIST_DIR}/../../configs/tiny_yolo3_anchors.txt" CACHE FILEPATH "anchors file for PGO training run")
+set(YOLO_PGO_CLASSES "${CMAKE_CURRENT_LIST_DIR}/../../configs/coco_classes.txt" CACHE FILEPATH "classes file for PGO training run")
+set(YOLO_PGO_IMAGES "${CMAKE_CURRENT_LIST_DIR}/../../example" CACHE PATH "image dir for PGO training run")
+
+set(YOLO_PGO_SCRIPT "${CMAKE_CURRENT_LIST_DIR}/YoloPGOBuild.cmake")
+
+
+# apply PGO/LTO flags of the cache options to target
+function(yolo_pgo_setup target)
+    set(compile_flags "")
+    set(link_flags "")
+
+    if(YOLO_PGO STREQUAL "GENERATE")
+        if(CMAKE_CXX_COMPILER_ID MATCHES "Clang")
+            set(compile_flags "-fprofile-generate=${YOLO_PGO_DIR}")
+        else()
+            # server/worker threads run the hot loops concurrently
+            set(compile_flags "-fprofile-generate=${YOLO_PGO_DIR} -fprofile-update=atomic")
+        endif()
+        set(link_flags "${compile_flags}")
+    elseif(YOLO_PGO STREQUAL "USE")
+        if(CMAKE_CXX_COMPILER_ID MATCHES "Clang")
+            # raw profiles are merged by YoloPGOBuild.cmake with llvm-profdata
+            set(compile_flags "-fprofile-use=${YOLO_PGO_DIR}/default.profdata")
+        else()
+            set(compile_flags "-fprofile-use=${YOLO_PGO_DIR} -fprofile-correction")
+        endif()
+        set(link_flags "${compile_flags}")
+    elseif(NOT YOLO_PGO STREQUAL "OFF")
+        message(FATAL_ERROR "Unknown YOLO_PGO mode ${YOLO_PGO}, should be OFF, GENERATE or USE")
+    endif()
+
+    # LTO is on for the profile optimized build, so hot inline paths
+    # could cross source files (e.g. resize -> kernels)
+    if(YOLO_LTO OR YOLO_PGO STREQUAL "USE")
+        set(compile_flags "${compile_flags} -flto")
+        set(link_flags "${link_flags} -flto")
+    endif()
+
+    if(NOT compile_flags STREQUAL "")
+        message(STATUS "${target}: PGO ${YOLO_PGO}, flags: ${compile_flags}")
+        set_property(TARGET ${target} APPEND_STRING PROPERTY COMPILE_FLAGS " ${compile_flags}")
+        set_property(TARGET ${target} APPEND_STRING PROPERTY LINK_FLAGS " ${link_flags}")
+    endif()
+
+    # one-shot PGO build target. app configure args (SDK path, etc.)
+    # are passed "|" separated, since a list would split the command
+    if(NOT YOLO_PGO_MODEL STREQUAL "")
+        string(REPLACE ";" "|" configure_args "${YOLO_PGO_CONFIGURE_ARGS}")
+        add_custom_target(pgo_build
+            COMMAND ${CMAKE_COMMAND}
+                -DSOURCE_DIR=${CMAKE_CURRENT_SOURCE_DIR}
+                -DBINARY_DIR=${CMAKE_BINARY_DIR}/pgo
+                -DTARGET=${target}
+                -DCXX_COMPILER=${CMAKE_CXX_COMPILER}
+                -DCONFIGURE_ARGS=${configure_args}
+                -DMODEL=${YOLO_PGO_MODEL}
+                -DANCHORS=${YOLO_PGO_ANCHORS}
+                -DCLASSES=${YOLO_PGO_CLASSES}
+                -DIMAGES=${YOLO_PGO_IMAGES}
+                -P ${YOLO_PGO_SCRIPT}
+            COMMENT "Build ${target} with PGO & LTO in ${CMAKE_BINARY_DIR}/pgo"
+            VERBATIM)
+    endif()
+endfunction()
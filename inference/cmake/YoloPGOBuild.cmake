@@ -0,0 +1,82 @@
+#### one-shot PGO & LTO build of a yoloDetection app, run by
+#### "make pgo_build" (see YoloPGO.cmake) as
+####
+#### cmake -DSOURCE_DIR=<app dir> -DBINARY_DIR=<build dir> -DTARGET=<target>
+####       -DCXX_COMPILER=<compiler> -DCONFIGURE_ARGS=<"|" separated args>
+####       -DMODEL=<model> -DANCHORS=<anchors> -DCLASSES=<classes>
+####       -DIMAGES=<image dir> -P YoloPGOBuild.cmake
+####
+#### 1. configure & build instrumented binary (YOLO_PGO=GENERATE)
+#### 2. training run: every image in IMAGES over the detector loop,
+####    with square and rectangular input
+#### 3. merge raw profile (Clang only)
+#### 4. reconfigure the same build dir & rebuild with YOLO_PGO=USE
+
+cmake_minimum_required(VERSION 3.5)
+
+foreach(var SOURCE_DIR BINARY_DIR TARGET MODEL ANCHORS CLASSES IMAGES)
+    if(NOT DEFINED ${var} OR "${${var}}" STREQUAL "")
+        message(FATAL_ERROR "PGO build: ${var} is not set")
+    endif()
+endforeach()
+
+string(REPLACE "|" ";" configure_args "${CONFIGURE_ARGS}")
+set(profile_dir "${BINARY_DIR}/pgo-profile")
+if(NOT "${CXX_COMPILER}" STREQUAL "")
+    list(APPEND configure_args "-DCMAKE_CXX_COMPILER=${CXX_COMPILER}")
+endif()
+
+
+function(run_step name)
+    execute_process(COMMAND ${ARGN}
+        WORKING_DIRECTORY ${BINARY_DIR}
+        RESULT_VARIABLE result)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "PGO build: ${name} failed (${result})")
+    endif()
+endfunction()
+
+
+function(build_phase mode)
+    message(STATUS "PGO build: ${mode} phase")
+    run_step("configure ${mode}" ${CMAKE_COMMAND} ${configure_args}
+        -DYOLO_PGO=${mode} -DYOLO_PGO_DIR=${profile_dir} -DYOLO_PGO_MODEL= ${SOURCE_DIR})
+    run_step("build ${mode}" ${CMAKE_COMMAND} --build . --target ${TARGET})
+endfunction()
+
+
+file(MAKE_DIRECTORY ${BINARY_DIR})
+# stale profile of old sources would be mismatched
+file(REMOVE_RECURSE ${profile_dir})
+file(MAKE_DIRECTORY ${profile_dir})
+
+build_phase(GENERATE)
+
+# training workload: loop the detector on every example image, so
+# preprocess, postprocess & NMS paths get representative counts
+file(GLOB images "${IMAGES}/*.jpg" "${IMAGES}/*.png")
+if(NOT images)
+    message(FATAL_ERROR "PGO build: no training image in ${IMAGES}")
+endif()
+foreach(image ${images})
+    get_filename_component(image_name ${image} NAME)
+    message(STATUS "PGO build: training on ${image_name}")
+    foreach(rect_input 0 1)
+        run_step("training run on ${image_name}" ${BINARY_DIR}/${TARGET}
+            -m ${MODEL} -a ${ANCHORS} -l ${CLASSES} -i ${image}
+            -R ${rect_input} -c 10 -w 1)
+    endforeach()
+endforeach()
+
+# Clang writes raw profile, which need to be merged for use
+file(GLOB raw_profiles "${profile_dir}/*.profraw")
+if(raw_profiles)
+    find_program(LLVM_PROFDATA NAMES llvm-profdata)
+    if(NOT LLVM_PROFDATA)
+        message(FATAL_ERROR "PGO build: llvm-profdata not found to merge Clang profile")
+    endif()
+    run_step("profile merge" ${LLVM_PROFDATA} merge -output=${profile_dir}/default.profdata ${raw_profiles})
+endif()
+
+build_phase(USE)
+message(STATUS "PGO build: optimized binary ${BINARY_DIR}/${TARGET}")
@@ -0,0 +1,192 @@
+//
+//  resultWriter.cpp
+//  YOLO inference common
+//
+//  Buffered writer for detection result, in text, JSON Lines
+//  or fixed-size binary record format
+//
+
+#include <string.h>
+#include "resultWriter.h"
+
+
+ResultWriter::ResultWriter(FILE* file, ResultFormat format, const std::vector<std::string>& classes,
+                           size_t buffer_size)
+    : mFile(file), mFormat(format), mClasses(classes), mBufferSize(buffer_size)
+{
+    mBuffer.reserve(mBufferSize + 4096);
+
+    if (mFormat == RESULT_BINARY) {
+        t_result_header header;
+        memcpy(header.magic, "YDET", 4);
+        header.version = 2;
+        header.record_size = sizeof(t_result_record);
+        header.num_classes = mClasses.size();
+        mBuffer.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    }
+}
+
+
+ResultWriter::~ResultWriter()
+{
+    flush();
+}
+
+
+void ResultWriter::append_json_string(const std::string& str)
+{
+    mBuffer.push_back('"');
+    for (auto c : str) {
+        switch (c) {
+            case '"':  mBuffer.append("\\\""); break;
+            case '\\': mBuffer.append("\\\\"); break;
+            case '\n': mBuffer.append("\\n"); break;
+            case '\r': mBuffer.append("\\r"); break;
+            case '\t': mBuffer.append("\\t"); break;
+            default:
+                if ((unsigned char)c < 0x20) {
+                    char escape[8];
+                    snprintf(escape, sizeof(escape), "\\u%04x", c);
+                    mBuffer.append(escape);
+                } else {
+                    mBuffer.push_back(c);
+                }
+        }
+    }
+    mBuffer.push_back('"');
+}
+
+
+void ResultWriter::write(const std::string& image_name, const int image_index, const int image_width, const int image_height,
+                         const std::vector<t_prediction>& prediction_nms_list)
+{
+    char line[256];
+
+    if (mFormat == RESULT_BINARY) {
+        t_result_record record;
+        record.image_index = image_index;
+        record.class_index = -1;
+        record.confidence = prediction_nms_list.size();
+        record.x = 0;
+        record.y = 0;
+        record.width = image_width;
+        record.height = image_height;
+        record.track_id = -1;
+        mBuffer.append(reinterpret_cast<const char*>(&record), sizeof(record));
+
+        for (auto& prediction_nms : prediction_nms_list) {
+            record.class_index = prediction_nms.class_index;
+            record.confidence = prediction_nms.confidence;
+            record.x = prediction_nms.x;
+            record.y = prediction_nms.y;
+            record.width = prediction_nms.width;
+            record.height = prediction_nms.height;
+            record.track_id = prediction_nms.track_id;
+            mBuffer.append(reinterpret_cast<const char*>(&record), sizeof(record));
+        }
+    }
+    else if (mFormat == RESULT_JSON) {
+        mBuffer.append("{\"image\":");
+        append_json_string(image_name);
+        snprintf(line, sizeof(line), ",\"index\":%d,\"width\":%d,\"height\":%d,\"detections\":[",
+                 image_index, image_width, image_height);
+        mBuffer.append(line);
+
+        for (size_t i = 0; i < prediction_nms_list.size(); i++) {
+            auto& prediction_nms = prediction_nms_list[i];
+            mBuffer.append(i == 0 ? "{\"class\":" : ",{\"class\":");
+            append_json_string(mClasses[prediction_nms.class_index]);
+            snprintf(line, sizeof(line), ",\"class_index\":%d,\"score\":%.6f,\"box\":[%d,%d,%d,%d]",
+                     prediction_nms.class_index, prediction_nms.confidence,
+                     int(prediction_nms.x), int(prediction_nms.y),
+                     int(prediction_nms.x + prediction_nms.width), int(prediction_nms.y + prediction_nms.height));
+            mBuffer.append(line);
+            if (prediction_nms.track_id >= 0) {
+                snprintf(line, sizeof(line), ",\"track_id\":%d", prediction_nms.track_id);
+                mBuffer.append(line);
+            }
+            mBuffer.push_back('}');
+        }
+        mBuffer.append("]}\n");
+    }
+    else {
+        for (auto& prediction_nms : prediction_nms_list) {
+            mBuffer.append(image_name);
+            snprintf(line, sizeof(line), " %s %f %d %d %d %d",
+                     mClasses[prediction_nms.class_index].c_str(), prediction_nms.confidence,
+                     int(prediction_nms.x), int(prediction_nms.y),
+                     int(prediction_nms.x + prediction_nms.width), int(prediction_nms.y + prediction_nms.height));
+            mBuffer.append(line);
+            // track id is appended as the last column for tracked object
+            if (prediction_nms.track_id >= 0) {
+                snprintf(line, sizeof(line), " %d", prediction_nms.track_id);
+                mBuffer.append(line);
+            }
+            mBuffer.push_back('\n');
+        }
+    }
+
+    if (mBuffer.size() >= mBufferSize) {
+        flush();
+    }
+    return;
+}
+
+
+bool ResultWriter::flush()
+{
+    bool ret = true;
+
+    if (!mBuffer.empty()) {
+        ret = (fwrite(mBuffer.data(), 1, mBuffer.size(), mFile) == mBuffer.size());
+        mBuffer.clear();
+    }
+    fflush(mFile);
+    return ret;
+}
+
+
+bool parse_result_format(const std::string& name, ResultFormat& format)
+{
+    if (name == "text") {
+        format = RESULT_TEXT;
+    } else if (name == "json") {
+        format = RESULT_JSON;
+    } else if (name == "binary") {
+        format = RESULT_BINARY;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+
+bool open_result_writer(const std::string& file_name, const std::string& format_name,
+                        const std::vector<std::string>& classes,
+                        std::unique_ptr<ResultWriter>& writer, FILE*& file)
+{
+    ResultFormat format;
+    if (!parse_result_format(format_name, format)) {
+        fprintf(stderr, "Invalid result format %s\n", format_name.c_str());
+        return false;
+    }
+
+    file = file_name.empty() ? stdout : fopen(file_name.c_str(), "wb");
+    if (file == nullptr) {
+        fprintf(stderr, "Can't open result file %s\n", file_name.c_str());
+        return false;
+    }
+    writer.reset(new ResultWriter(file, format, classes));
+    return true;
+}
+
+
+void close_result_writer(std::unique_ptr<ResultWriter>& writer, FILE*& file)
+{
+    writer.reset();
+    if (file != nullptr && file != stdout) {
+        fclose(file);
+    }
+    file = nullptr;
+    return;
+}
@@ -0,0 +1,89 @@
+//
+//  resultWriter.h
+//  YOLO inference common
+//
+//  Buffered writer for detection result, in text, JSON Lines
+//  or fixed-size binary record format
+//
+
+#ifndef YOLO_DETECTION_RESULT_WRITER_H_
+#define YOLO_DETECTION_RESULT_WRITER_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "yoloPrediction.h"
+
+
+// detection result output format
+enum ResultFormat {
+    RESULT_TEXT = 0,    // "image_name class score xmin ymin xmax ymax [track_id]" line for each object
+    RESULT_JSON = 1,    // one JSON object line for each image
+    RESULT_BINARY = 2,  // result file header and t_result_record stream
+};
+
+// binary result file header
+typedef struct result_header {
+    char magic[4];          // "YDET"
+    uint32_t version;       // 2
+    uint32_t record_size;   // sizeof(t_result_record)
+    uint32_t num_classes;
+}t_result_header;
+
+// binary result record, in host byte order. every image starts
+// with an image record (class_index -1, confidence is the object
+// number, width/height is the image shape), followed by the
+// object records of t_prediction box in origin image coordinate.
+// track_id is -1 if object is not tracked
+typedef struct result_record {
+    uint32_t image_index;
+    int32_t class_index;
+    float confidence;
+    float x;
+    float y;
+    float width;
+    float height;
+    int32_t track_id;
+}t_result_record;
+
+
+class ResultWriter {
+public:
+    ResultWriter(FILE* file, ResultFormat format, const std::vector<std::string>& classes,
+                 size_t buffer_size = 1 << 20);
+    ~ResultWriter();
+
+    // append detection result of one image
+    void write(const std::string& image_name, const int image_index, const int image_width, const int image_height,
+               const std::vector<t_prediction>& prediction_nms_list);
+    // write out all the buffered result
+    bool flush();
+
+private:
+    void append_json_string(const std::string& str);
+
+    FILE* mFile;
+    ResultFormat mFormat;
+    const std::vector<std::string>& mClasses;
+    size_t mBufferSize;
+    std::string mBuffer;
+};
+
+
+// parse result format name (text/json/binary)
+bool parse_result_format(const std::string& name, ResultFormat& format);
+
+// open result file (stdout if file name is empty) and its writer of
+// format name. error is printed to stderr on failure, and nothing is
+// left open
+bool open_result_writer(const std::string& file_name, const std::string& format_name,
+                        const std::vector<std::string>& classes,
+                        std::unique_ptr<ResultWriter>& writer, FILE*& file);
+
+// flush & release the writer, and close the result file (not stdout)
+void close_result_writer(std::unique_ptr<ResultWriter>& writer, FILE*& file);
+
+#endif  // YOLO_DETECTION_RESULT_WRITER_H_
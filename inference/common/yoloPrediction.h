@@ -0,0 +1,23 @@
+//
+//  yoloPrediction.h
+//  YOLO inference common
+//
+//  Bbox prediction record shared by MNN & TFLite app
+//
+
+#ifndef YOLO_DETECTION_YOLO_PREDICTION_H_
+#define YOLO_DETECTION_YOLO_PREDICTION_H_
+
+
+// definition of a bbox prediction record
+typedef struct prediction {
+    float x;
+    float y;
+    float width;
+    float height;
+    float confidence;
+    int class_index;
+    int track_id;       // -1 if not tracked
+}t_prediction;
+
+#endif  // YOLO_DETECTION_YOLO_PREDICTION_H_
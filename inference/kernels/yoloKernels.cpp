@@ -0,0 +1,143 @@
+//
+//  yoloKernels.cpp
+//  YOLO inference kernels
+//
+//  Generic C++ kernels, and runtime variant selection by
+//  cpuid (x86) or hwcap (ARM)
+//
+
+#include <stdio.h>
+#include <atomic>
+#include <string>
+#if defined(__linux__) && (defined(__aarch64__) || defined(__arm__))
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+#include "yoloKernels.h"
+
+
+static void normalize_generic(const uint8_t* in, float* out, int count, float mean, float scale)
+{
+    for (int i = 0; i < count; i++) {
+        out[i] = (in[i] - mean) * scale;
+    }
+    return;
+}
+
+
+static float max_index_generic(const float* data, int count, int* index)
+{
+    float max_value = data[0];
+    *index = 0;
+    for (int i = 1; i < count; i++) {
+        if (data[i] > max_value) {
+            max_value = data[i];
+            *index = i;
+        }
+    }
+    return max_value;
+}
+
+
+static int threshold_index_generic(const float* data, int count, float threshold, int* indices)
+{
+    // branchless, index is always written and kept only if passed
+    int num = 0;
+    for (int i = 0; i < count; i++) {
+        indices[num] = i;
+        num += (data[i] >= threshold);
+    }
+    return num;
+}
+
+
+const t_kernel_table kernels_generic = {
+    "generic",
+    normalize_generic,
+    max_index_generic,
+    threshold_index_generic,
+};
+
+
+static bool cpu_supports(const t_kernel_table* kernels)
+{
+    std::string name = kernels->name;
+    if (name == "generic") {
+        return true;
+    }
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (name == "sse4.1") {
+        return __builtin_cpu_supports("sse4.1");
+    } else if (name == "avx2") {
+        return __builtin_cpu_supports("avx2");
+    } else if (name == "avx512") {
+        return __builtin_cpu_supports("avx512f");
+    }
+#elif defined(__aarch64__)
+    // Advanced SIMD is mandatory on AArch64
+    if (name == "neon") {
+        return true;
+    }
+#elif defined(__arm__) && defined(__linux__)
+    if (name == "neon") {
+        return (getauxval(AT_HWCAP) & HWCAP_NEON) != 0;
+    }
+#endif
+    return false;
+}
+
+
+// built variants, best first
+static const t_kernel_table* const g_kernel_variants[] = {
+#if defined(__x86_64__) || defined(__i386__)
+    &kernels_avx512,
+    &kernels_avx2,
+    &kernels_sse41,
+#endif
+#if defined(__aarch64__) || defined(__arm__)
+    &kernels_neon,
+#endif
+    &kernels_generic,
+};
+
+static std::atomic<const t_kernel_table*> g_kernels(nullptr);
+
+
+static const t_kernel_table* select_kernels()
+{
+    for (auto kernels : g_kernel_variants) {
+        if (cpu_supports(kernels)) {
+            return kernels;
+        }
+    }
+    return &kernels_generic;
+}
+
+
+const t_kernel_table* get_kernels()
+{
+    auto kernels = g_kernels.load(std::memory_order_acquire);
+    if (kernels == nullptr) {
+        kernels = select_kernels();
+        g_kernels.store(kernels, std::memory_order_release);
+    }
+    return kernels;
+}
+
+
+bool set_kernel_variant(const std::string& name)
+{
+    if (name.empty() || name == "auto") {
+        g_kernels.store(select_kernels(), std::memory_order_release);
+        return true;
+    }
+    for (auto kernels : g_kernel_variants) {
+        if (name == kernels->name && cpu_supports(kernels)) {
+            g_kernels.store(kernels, std::memory_order_release);
+            return true;
+        }
+    }
+    return false;
+}
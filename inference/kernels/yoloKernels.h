@@ -0,0 +1,53 @@
+//
+//  yoloKernels.h
+//  YOLO inference kernels
+//
+//  Hand-written pre/postprocess kernels shared by MNN & TFLite
+//  app. Every kernel is built in several CPU variants in one
+//  binary, and the variant is picked at runtime by CPU feature
+//
+
+#ifndef YOLO_DETECTION_YOLO_KERNELS_H_
+#define YOLO_DETECTION_YOLO_KERNELS_H_
+
+#include <stdint.h>
+#include <string>
+
+
+typedef struct kernel_table {
+    const char* name;
+
+    // preprocess: out[i] = (in[i] - mean) * scale, scale is 1/std
+    void (*normalize)(const uint8_t* in, float* out, int count, float mean, float scale);
+
+    // postprocess: get max value of a contiguous float array, and
+    // index of its first occurrence
+    float (*max_index)(const float* data, int count, int* index);
+
+    // postprocess: write index of every value >= threshold to indices
+    // in order, and return the number. indices should hold count ints
+    int (*threshold_index)(const float* data, int count, float threshold, int* indices);
+}t_kernel_table;
+
+
+// variants built for the target arch, in preference order. CPU
+// support is checked when selecting
+extern const t_kernel_table kernels_generic;
+#if defined(__x86_64__) || defined(__i386__)
+extern const t_kernel_table kernels_sse41;
+extern const t_kernel_table kernels_avx2;
+extern const t_kernel_table kernels_avx512;
+#endif
+#if defined(__aarch64__) || defined(__arm__)
+extern const t_kernel_table kernels_neon;
+#endif
+
+// get the kernels, auto selected by CPU feature on first call
+const t_kernel_table* get_kernels();
+
+// force kernel variant by name (generic/sse4.1/avx2/avx512/neon, or
+// auto), for benchmark. return false if the variant is not built for
+// the arch or not supported by CPU
+bool set_kernel_variant(const std::string& name);
+
+#endif  // YOLO_DETECTION_YOLO_KERNELS_H_
@@ -0,0 +1,108 @@
+//
+//  yoloKernels_arm.cpp
+//  YOLO inference kernels
+//
+//  NEON kernels. On 32-bit ARM the file is built with -mfpu=neon
+//  (see CMakeLists.txt), and only called if hwcap reports NEON
+//
+
+#if defined(__aarch64__) || defined(__arm__)
+
+#include <arm_neon.h>
+#include "yoloKernels.h"
+
+
+static void normalize_neon(const uint8_t* in, float* out, int count, float mean, float scale)
+{
+    float32x4_t mean_vec = vdupq_n_f32(mean);
+    float32x4_t scale_vec = vdupq_n_f32(scale);
+
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        uint8x16_t pixels = vld1q_u8(in + i);
+        uint16x8_t low = vmovl_u8(vget_low_u8(pixels));
+        uint16x8_t high = vmovl_u8(vget_high_u8(pixels));
+
+        uint32x4_t values[4] = {
+            vmovl_u16(vget_low_u16(low)), vmovl_u16(vget_high_u16(low)),
+            vmovl_u16(vget_low_u16(high)), vmovl_u16(vget_high_u16(high)),
+        };
+        for (int j = 0; j < 4; j++) {
+            float32x4_t result = vmulq_f32(vsubq_f32(vcvtq_f32_u32(values[j]), mean_vec), scale_vec);
+            vst1q_f32(out + i + j * 4, result);
+        }
+    }
+    for (; i < count; i++) {
+        out[i] = (in[i] - mean) * scale;
+    }
+    return;
+}
+
+
+static float max_index_neon(const float* data, int count, int* index)
+{
+    float max_value = data[0];
+    int i = 0;
+    if (count >= 4) {
+        float32x4_t max_vec = vld1q_f32(data);
+        for (i = 4; i + 4 <= count; i += 4) {
+            max_vec = vmaxq_f32(max_vec, vld1q_f32(data + i));
+        }
+        // pairwise max works on both ARMv7 & AArch64
+        float32x2_t max_half = vpmax_f32(vget_low_f32(max_vec), vget_high_f32(max_vec));
+        max_half = vpmax_f32(max_half, max_half);
+        max_value = vget_lane_f32(max_half, 0);
+    }
+    for (; i < count; i++) {
+        max_value = (data[i] > max_value) ? data[i] : max_value;
+    }
+
+    *index = 0;
+    for (int j = 0; j < count; j++) {
+        if (data[j] == max_value) {
+            *index = j;
+            break;
+        }
+    }
+    return max_value;
+}
+
+
+static int threshold_index_neon(const float* data, int count, float threshold, int* indices)
+{
+    float32x4_t threshold_vec = vdupq_n_f32(threshold);
+
+    int num = 0;
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        uint32x4_t mask = vcgeq_f32(vld1q_f32(data + i), threshold_vec);
+        // candidates are sparse, so test any lane passed first. pairwise
+        // max works on both ARMv7 & AArch64
+        uint32x2_t any = vpmax_u32(vget_low_u32(mask), vget_high_u32(mask));
+        any = vpmax_u32(any, any);
+        if (vget_lane_u32(any, 0) == 0) {
+            continue;
+        }
+        for (int j = 0; j < 4; j++) {
+            if (data[i + j] >= threshold) {
+                indices[num++] = i + j;
+            }
+        }
+    }
+    for (; i < count; i++) {
+        if (data[i] >= threshold) {
+            indices[num++] = i;
+        }
+    }
+    return num;
+}
+
+
+const t_kernel_table kernels_neon = {
+    "neon",
+    normalize_neon,
+    max_index_neon,
+    threshold_index_neon,
+};
+
+#endif  // __aarch64__ || __arm__
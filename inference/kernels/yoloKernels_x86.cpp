@@ -0,0 +1,253 @@
+//
+//  yoloKernels_x86.cpp
+//  YOLO inference kernels
+//
+//  SSE4.1/AVX2/AVX-512 kernels. Each function is compiled for
+//  its own instruction set with target attribute, so the file
+//  builds with baseline flags and the variant is only called on
+//  CPU supporting it
+//
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+#include "yoloKernels.h"
+
+
+// first index of value, after the max is found with SIMD
+static inline int find_index(const float* data, int count, float value)
+{
+    for (int i = 0; i < count; i++) {
+        if (data[i] == value) {
+            return i;
+        }
+    }
+    return 0;
+}
+
+
+// append index of set bits in compare mask, lowest first. candidates
+// are sparse, so most masks are 0 and skipped
+static inline int append_mask(unsigned int mask, int base, int* indices, int num)
+{
+    while (mask) {
+        indices[num++] = base + __builtin_ctz(mask);
+        mask &= mask - 1;
+    }
+    return num;
+}
+
+
+__attribute__((target("sse4.1")))
+static void normalize_sse41(const uint8_t* in, float* out, int count, float mean, float scale)
+{
+    __m128 mean_vec = _mm_set1_ps(mean);
+    __m128 scale_vec = _mm_set1_ps(scale);
+
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i pixels = _mm_loadu_si128((const __m128i*)(in + i));
+        for (int j = 0; j < 4; j++) {
+            __m128i value = _mm_cvtepu8_epi32(pixels);
+            __m128 result = _mm_mul_ps(_mm_sub_ps(_mm_cvtepi32_ps(value), mean_vec), scale_vec);
+            _mm_storeu_ps(out + i + j * 4, result);
+            pixels = _mm_srli_si128(pixels, 4);
+        }
+    }
+    for (; i < count; i++) {
+        out[i] = (in[i] - mean) * scale;
+    }
+    return;
+}
+
+
+__attribute__((target("sse4.1")))
+static float max_index_sse41(const float* data, int count, int* index)
+{
+    float max_value = data[0];
+    int i = 0;
+    if (count >= 4) {
+        __m128 max_vec = _mm_loadu_ps(data);
+        for (i = 4; i + 4 <= count; i += 4) {
+            max_vec = _mm_max_ps(max_vec, _mm_loadu_ps(data + i));
+        }
+        max_vec = _mm_max_ps(max_vec, _mm_shuffle_ps(max_vec, max_vec, _MM_SHUFFLE(1, 0, 3, 2)));
+        max_vec = _mm_max_ps(max_vec, _mm_shuffle_ps(max_vec, max_vec, _MM_SHUFFLE(2, 3, 0, 1)));
+        max_value = _mm_cvtss_f32(max_vec);
+    }
+    for (; i < count; i++) {
+        max_value = (data[i] > max_value) ? data[i] : max_value;
+    }
+
+    *index = find_index(data, count, max_value);
+    return max_value;
+}
+
+
+__attribute__((target("sse4.1")))
+static int threshold_index_sse41(const float* data, int count, float threshold, int* indices)
+{
+    __m128 threshold_vec = _mm_set1_ps(threshold);
+
+    int num = 0;
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        unsigned int mask = _mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(data + i), threshold_vec));
+        num = append_mask(mask, i, indices, num);
+    }
+    for (; i < count; i++) {
+        if (data[i] >= threshold) {
+            indices[num++] = i;
+        }
+    }
+    return num;
+}
+
+
+__attribute__((target("avx2")))
+static void normalize_avx2(const uint8_t* in, float* out, int count, float mean, float scale)
+{
+    __m256 mean_vec = _mm256_set1_ps(mean);
+    __m256 scale_vec = _mm256_set1_ps(scale);
+
+    // sub & mul (no FMA), to get same result as other variants
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i value = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(in + i)));
+        __m256 result = _mm256_mul_ps(_mm256_sub_ps(_mm256_cvtepi32_ps(value), mean_vec), scale_vec);
+        _mm256_storeu_ps(out + i, result);
+    }
+    for (; i < count; i++) {
+        out[i] = (in[i] - mean) * scale;
+    }
+    return;
+}
+
+
+__attribute__((target("avx2")))
+static float max_index_avx2(const float* data, int count, int* index)
+{
+    float max_value = data[0];
+    int i = 0;
+    if (count >= 8) {
+        __m256 max_vec = _mm256_loadu_ps(data);
+        for (i = 8; i + 8 <= count; i += 8) {
+            max_vec = _mm256_max_ps(max_vec, _mm256_loadu_ps(data + i));
+        }
+        __m128 max_half = _mm_max_ps(_mm256_castps256_ps128(max_vec), _mm256_extractf128_ps(max_vec, 1));
+        max_half = _mm_max_ps(max_half, _mm_shuffle_ps(max_half, max_half, _MM_SHUFFLE(1, 0, 3, 2)));
+        max_half = _mm_max_ps(max_half, _mm_shuffle_ps(max_half, max_half, _MM_SHUFFLE(2, 3, 0, 1)));
+        max_value = _mm_cvtss_f32(max_half);
+    }
+    for (; i < count; i++) {
+        max_value = (data[i] > max_value) ? data[i] : max_value;
+    }
+
+    *index = find_index(data, count, max_value);
+    return max_value;
+}
+
+
+__attribute__((target("avx2")))
+static int threshold_index_avx2(const float* data, int count, float threshold, int* indices)
+{
+    __m256 threshold_vec = _mm256_set1_ps(threshold);
+
+    int num = 0;
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        unsigned int mask = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(data + i), threshold_vec, _CMP_GE_OQ));
+        num = append_mask(mask, i, indices, num);
+    }
+    for (; i < count; i++) {
+        if (data[i] >= threshold) {
+            indices[num++] = i;
+        }
+    }
+    return num;
+}
+
+
+__attribute__((target("avx512f")))
+static void normalize_avx512(const uint8_t* in, float* out, int count, float mean, float scale)
+{
+    __m512 mean_vec = _mm512_set1_ps(mean);
+    __m512 scale_vec = _mm512_set1_ps(scale);
+
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m512i value = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i*)(in + i)));
+        __m512 result = _mm512_mul_ps(_mm512_sub_ps(_mm512_cvtepi32_ps(value), mean_vec), scale_vec);
+        _mm512_storeu_ps(out + i, result);
+    }
+    for (; i < count; i++) {
+        out[i] = (in[i] - mean) * scale;
+    }
+    return;
+}
+
+
+__attribute__((target("avx512f")))
+static float max_index_avx512(const float* data, int count, int* index)
+{
+    float max_value = data[0];
+    int i = 0;
+    if (count >= 16) {
+        __m512 max_vec = _mm512_loadu_ps(data);
+        for (i = 16; i + 16 <= count; i += 16) {
+            max_vec = _mm512_max_ps(max_vec, _mm512_loadu_ps(data + i));
+        }
+        max_value = _mm512_reduce_max_ps(max_vec);
+    }
+    for (; i < count; i++) {
+        max_value = (data[i] > max_value) ? data[i] : max_value;
+    }
+
+    *index = find_index(data, count, max_value);
+    return max_value;
+}
+
+
+__attribute__((target("avx512f")))
+static int threshold_index_avx512(const float* data, int count, float threshold, int* indices)
+{
+    __m512 threshold_vec = _mm512_set1_ps(threshold);
+
+    int num = 0;
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __mmask16 mask = _mm512_cmp_ps_mask(_mm512_loadu_ps(data + i), threshold_vec, _CMP_GE_OQ);
+        num = append_mask(mask, i, indices, num);
+    }
+    // tail with masked load, no scalar loop
+    if (i < count) {
+        __mmask16 tail = (__mmask16)((1u << (count - i)) - 1);
+        __mmask16 mask = _mm512_mask_cmp_ps_mask(tail, _mm512_maskz_loadu_ps(tail, data + i), threshold_vec, _CMP_GE_OQ);
+        num = append_mask(mask, i, indices, num);
+    }
+    return num;
+}
+
+
+const t_kernel_table kernels_sse41 = {
+    "sse4.1",
+    normalize_sse41,
+    max_index_sse41,
+    threshold_index_sse41,
+};
+
+const t_kernel_table kernels_avx2 = {
+    "avx2",
+    normalize_avx2,
+    max_index_avx2,
+    threshold_index_avx2,
+};
+
+const t_kernel_table kernels_avx512 = {
+    "avx512",
+    normalize_avx512,
+    max_index_avx512,
+    threshold_index_avx512,
+};
+
+#endif  // __x86_64__ || __i386__
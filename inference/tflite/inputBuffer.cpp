@@ -0,0 +1,81 @@
+//
+//  inputBuffer.cpp
+//  Tensorflow-lite
+//
+//  Ring of aligned input buffers bound with custom allocation
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+
+#include "inputBuffer.h"
+
+#define LOG(x) std::cerr
+
+namespace yoloDetection {
+
+InputBufferRing::InputBufferRing()
+    : mInterpreter(nullptr), mTensorIndex(-1), mBytes(0)
+{
+}
+
+
+InputBufferRing::~InputBufferRing()
+{
+    release();
+}
+
+
+void InputBufferRing::release()
+{
+    for (auto buffer : mBuffers) {
+        free(buffer);
+    }
+    mBuffers.clear();
+    return;
+}
+
+
+bool InputBufferRing::init(tflite::Interpreter* interpreter, int tensor_index, int num_buffers)
+{
+    release();
+    mInterpreter = interpreter;
+    mTensorIndex = tensor_index;
+
+    // round up to alignment, so a whole vector store at tail is safe
+    size_t tensor_bytes = interpreter->tensor(tensor_index)->bytes;
+    mBytes = (tensor_bytes + INPUT_BUFFER_ALIGNMENT - 1) / INPUT_BUFFER_ALIGNMENT * INPUT_BUFFER_ALIGNMENT;
+
+    for (int i = 0; i < num_buffers; i++) {
+        void* buffer = nullptr;
+        if (posix_memalign(&buffer, INPUT_BUFFER_ALIGNMENT, mBytes) != 0) {
+            LOG(ERROR) << "Can't alloc input buffer\n";
+            release();
+            return false;
+        }
+        memset(buffer, 0, mBytes);
+        mBuffers.emplace_back((uint8_t*)buffer);
+    }
+    return true;
+}
+
+
+bool InputBufferRing::bind(int index)
+{
+    TfLiteCustomAllocation allocation = {mBuffers[index], mBytes};
+    if (mInterpreter->SetCustomAllocationForTensor(mTensorIndex, allocation) != kTfLiteOk) {
+        LOG(ERROR) << "Failed to bind input buffer " << index << "\n";
+        return false;
+    }
+
+    // AllocateTensors() is required after binding. with unchanged shape
+    // it only verifies the custom allocation, no memory re-planning
+    if (mInterpreter->AllocateTensors() != kTfLiteOk) {
+        LOG(ERROR) << "Failed to allocate tensors with input buffer " << index << "\n";
+        return false;
+    }
+    return true;
+}
+
+}  // namespace yoloDetection
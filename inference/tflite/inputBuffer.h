@@ -0,0 +1,52 @@
+//
+//  inputBuffer.h
+//  Tensorflow-lite
+//
+//  Ring of aligned input buffers owned by preprocess stage, bound to
+//  the interpreter input tensor with custom allocation, so the next
+//  frame could be preprocessed while the bound one is being invoked
+//
+
+#ifndef YOLO_DETECTION_INPUT_BUFFER_H_
+#define YOLO_DETECTION_INPUT_BUFFER_H_
+
+#include <stdint.h>
+#include <vector>
+
+#include "tensorflow/lite/interpreter.h"
+
+namespace yoloDetection {
+
+// TFLite requires custom allocation aligned to kDefaultTensorAlignment
+#define INPUT_BUFFER_ALIGNMENT 64
+
+class InputBufferRing {
+public:
+    InputBufferRing();
+    ~InputBufferRing();
+
+    // allocate buffers for the input tensor in its current shape, so
+    // should be called after the last input resize & AllocateTensors()
+    bool init(tflite::Interpreter* interpreter, int tensor_index, int num_buffers);
+
+    // bind buffer to input tensor for next Invoke(). the buffer should
+    // not be written until another one is bound
+    bool bind(int index);
+
+    // buffer of index to preprocess a frame into
+    uint8_t* buffer(int index) const { return mBuffers[index]; }
+    int size() const { return mBuffers.size(); }
+    size_t bytes() const { return mBytes; }
+
+private:
+    void release();
+
+    tflite::Interpreter* mInterpreter;
+    int mTensorIndex;
+    size_t mBytes;
+    std::vector<uint8_t*> mBuffers;
+};
+
+}  // namespace yoloDetection
+
+#endif  // YOLO_DETECTION_INPUT_BUFFER_H_
@@ -16,6 +16,7 @@
 #include <cstdarg>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
@@ -27,13 +28,20 @@
 #include <vector>
 #include <numeric>
 #include <algorithm>
+#include <future>
 
 #include "tensorflow/lite/builtin_op_data.h"
 #include "tensorflow/lite/interpreter.h"
 #include "tensorflow/lite/kernels/register.h"
 #include "tensorflow/lite/string_util.h"
+#ifdef USE_XNNPACK
+#include "tensorflow/lite/delegates/xnnpack/xnnpack_delegate.h"
+#endif
 
 #include "yoloDetection.h"
+#include "yoloKernels.h"
+#include "resultWriter.h"
+#include "inputBuffer.h"
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 #define STB_IMAGE_RESIZE_IMPLEMENTATION
@@ -43,16 +51,6 @@
 
 namespace yoloDetection {
 
-// definition of a bbox prediction record
-typedef struct prediction {
-    float x;
-    float y;
-    float width;
-    float height;
-    float confidence;
-    int class_index;
-}t_prediction;
-
 float sigmoid(float x)
 {
     return (1 / (1 + exp(-x)));
@@ -131,6 +129,11 @@ void yolo_postprocess(const TfLiteTensor* feature_map, const int input_width, co
     auto unit = sizeof(float);
     int anchor_num_per_layer = anchors.size();
 
+    // model input could be rectangular, but x/y stride should be same
+    assert(input_height / height == stride);
+
+    const t_kernel_table* kernels = get_kernels();
+
     // TF/TFLite tensor format: NHWC
     auto bytesPerRow   = channel * unit;
     auto bytesPerImage = width * bytesPerRow;
@@ -181,19 +184,27 @@ void yolo_postprocess(const TfLiteTensor* feature_map, const int input_width, co
                     //get anchor output confidence (class_score * objectness) and filter with threshold
                     float max_conf = 0.0;
                     int max_index = -1;
-                    for (int i = 0; i < num_classes; i++) {
-                        float tmp_conf = 0.0;
-                        if(anchor_num_per_layer == 5) {
-                            // YOLOv2 use 5 anchors and softmax class scores
-                            tmp_conf = bbox_score[i] * bbox_obj;
-                        }
-                        else {
-                            tmp_conf = sigmoid(bytes[bbox_scores_offset + i * bbox_scores_step]) * bbox_obj;
-                        }
-
-                        if(tmp_conf > max_conf) {
-                            max_conf = tmp_conf;
-                            max_index = i;
+                    if (anchor_num_per_layer != 5 && bbox_scores_step == 1) {
+                        // sigmoid is monotonic, so max is picked on contiguous class
+                        // logits with the kernel of CPU variant, and only one sigmoid
+                        // is needed
+                        float max_logit = kernels->max_index(bytes + bbox_scores_offset, num_classes, &max_index);
+                        max_conf = sigmoid(max_logit) * bbox_obj;
+                    } else {
+                        for (int i = 0; i < num_classes; i++) {
+                            float tmp_conf = 0.0;
+                            if(anchor_num_per_layer == 5) {
+                                // YOLOv2 use 5 anchors and softmax class scores
+                                tmp_conf = bbox_score[i] * bbox_obj;
+                            }
+                            else {
+                                tmp_conf = sigmoid(bytes[bbox_scores_offset + i * bbox_scores_step]) * bbox_obj;
+                            }
+
+                            if(tmp_conf > max_conf) {
+                                max_conf = tmp_conf;
+                                max_index = i;
+                            }
                         }
                     }
                     if(max_conf >= conf_threshold) {
@@ -205,6 +216,7 @@ void yolo_postprocess(const TfLiteTensor* feature_map, const int input_width, co
                         bbox_prediction.height = bbox_h;
                         bbox_prediction.confidence = max_conf;
                         bbox_prediction.class_index = max_index;
+                        bbox_prediction.track_id = -1;
 
                         prediction_list.emplace_back(bbox_prediction);
                     }
@@ -259,7 +271,8 @@ void parse_anchors(std::string line, std::vector<std::pair<float, float>>& ancho
 
 
 // select anchorset for corresponding featuremap layer
-std::vector<std::pair<float, float>> get_anchorset(std::vector<std::pair<float, float>> anchors, const int feature_width, const int input_width)
+std::vector<std::pair<float, float>> get_anchorset(std::vector<std::pair<float, float>> anchors, const int feature_width, const int feature_height,
+                                                   const int input_width, const int input_height)
 {
     std::vector<std::pair<float, float>> anchorset;
     int anchor_num = anchors.size();
@@ -269,7 +282,13 @@ std::vector<std::pair<float, float>> get_anchorset(std::vector<std::pair<float,
     // stride 32: 1 x 13 x 13 x 3 x (num_classes + 5)
     // stride 16: 1 x 26 x 26 x 3 x (num_classes + 5)
     // stride 8: 1 x 52 x 52 x 3 x (num_classes + 5)
+    // input & feature map could be rectangular (e.g. 608x352 -> 19x11)
+    // but stride on width and height should be same
     int stride = input_width / feature_width;
+    if (input_height / feature_height != stride) {
+        LOG(ERROR) << "mismatch feature map stride on width & height!\n";
+        exit(-1);
+    }
 
     // YOLOv3 model has 9 anchors and 3 feature layers
     if (anchor_num == 9) {
@@ -410,67 +429,111 @@ void nms_boxes(const std::vector<t_prediction> prediction_list, std::vector<t_pr
 }
 
 
-void adjust_boxes(std::vector<t_prediction> &prediction_nms_list, int image_width, int image_height, int input_width, int input_height)
+// get letterbox image shape, which pads the short side of origin
+// image to aspect ratio of model input, so that the letterbox image
+// could be resized to model input without distortion
+void get_letterbox_shape(int image_width, int image_height, int input_width, int input_height,
+                         int& letterbox_width, int& letterbox_height)
 {
-    // Rescale the final prediction (letterboxed) back to original image
-    assert(input_width == input_height);
-
-    int square_dim = std::max(image_width, image_height);
-    float scale = float(square_dim) / float(input_width);
-    int x_offset, y_offset;
-
-    if ( image_width > image_height ) {
-        x_offset = 0;
-        y_offset = floor((image_width - image_height) / 2);
+    if (int64_t(image_width) * input_height >= int64_t(image_height) * input_width) {
+        letterbox_width = image_width;
+        letterbox_height = (int64_t(image_width) * input_height + input_width - 1) / input_width;
     }
     else {
-        x_offset = floor((image_height - image_width) / 2);
-        y_offset = 0;
+        letterbox_width = (int64_t(image_height) * input_width + input_height - 1) / input_height;
+        letterbox_height = image_height;
     }
+    return;
+}
 
 
+// get minimal model input shape of stride 32 multiple to fit in the
+// image with unchanged aspect ratio, within max input width/height.
+// e.g. 1920x1080 image with max 608x608 input gets 608x352 input
+void get_rect_input_shape(int image_width, int image_height, int max_input_width, int max_input_height,
+                          int& input_width, int& input_height)
+{
+    float scale = std::min(float(max_input_width) / image_width, float(max_input_height) / image_height);
+
+    input_width = std::min(max_input_width, int(ceil(image_width * scale / 32)) * 32);
+    input_height = std::min(max_input_height, int(ceil(image_height * scale / 32)) * 32);
+    return;
+}
+
+
+void adjust_boxes(std::vector<t_prediction> &prediction_nms_list, int image_width, int image_height, int input_width, int input_height)
+{
+    // Rescale the final prediction (letterboxed) back to original image
+    int letterbox_width, letterbox_height;
+    get_letterbox_shape(image_width, image_height, input_width, input_height, letterbox_width, letterbox_height);
+
+    float x_scale = float(letterbox_width) / float(input_width);
+    float y_scale = float(letterbox_height) / float(input_height);
+    int x_offset = (letterbox_width - image_width) / 2;
+    int y_offset = (letterbox_height - image_height) / 2;
+
     for(auto &prediction_nms : prediction_nms_list) {
-        prediction_nms.x = prediction_nms.x * scale - x_offset;
-        prediction_nms.y = prediction_nms.y * scale - y_offset;
-        prediction_nms.width = prediction_nms.width * scale;
-        prediction_nms.height = prediction_nms.height * scale;
+        prediction_nms.x = prediction_nms.x * x_scale - x_offset;
+        prediction_nms.y = prediction_nms.y * y_scale - y_offset;
+        prediction_nms.width = prediction_nms.width * x_scale;
+        prediction_nms.height = prediction_nms.height * y_scale;
     }
 
     return;
 }
 
 //Resize image with unchanged aspect ratio using padding
-uint8_t* letterbox_image(uint8_t* inputImage, int image_width, int image_height, int image_channel)
+uint8_t* letterbox_image(uint8_t* inputImage, int image_width, int image_height, int image_channel,
+                         int input_width, int input_height, int& letterbox_width, int& letterbox_height)
 {
-    // if input image is square, just return original
-    if (image_width == image_height) {
+    get_letterbox_shape(image_width, image_height, input_width, input_height, letterbox_width, letterbox_height);
+
+    // if input image already fits model input, just return original
+    if (letterbox_width == image_width && letterbox_height == image_height) {
         return inputImage;
     }
 
-    int square_dim = std::max(image_width, image_height);
-    int x_offset, y_offset;
+    int x_offset = (letterbox_width - image_width) / 2;
+    int y_offset = (letterbox_height - image_height) / 2;
 
-    uint8_t* squareImage = (uint8_t*)malloc(square_dim * square_dim * image_channel * sizeof(uint8_t));
-
-    if ( image_width > image_height ) {
-        x_offset = 0;
-        y_offset = floor((image_width - image_height) / 2);
-    }
-    else {
-        x_offset = floor((image_height - image_width) / 2);
-        y_offset = 0;
+    uint8_t* letterboxImage = (uint8_t*)malloc(letterbox_width * letterbox_height * image_channel * sizeof(uint8_t));
+    if (letterboxImage == nullptr) {
+        LOG(FATAL) << "Can't alloc memory\n";
+        exit(-1);
     }
 
-    // paste input image into square image
+    // fill padding area with grey (128), same as letterbox_resize() in training
+    memset(letterboxImage, 128, letterbox_width * letterbox_height * image_channel * sizeof(uint8_t));
+
+    // paste input image into letterbox image
     for (int h = 0; h < image_height; h++) {
-        for (int w = 0; w < image_width; w++) {
-            for (int c = 0; c < image_channel; c++) {
-                squareImage[(h+y_offset)*square_dim*image_channel + (w+x_offset)*image_channel + c] = inputImage[h*image_width*image_channel + w*image_channel + c];
-            }
+        memcpy(letterboxImage + ((h + y_offset) * letterbox_width + x_offset) * image_channel,
+               inputImage + h * image_width * image_channel,
+               image_width * image_channel * sizeof(uint8_t));
+    }
+
+    return letterboxImage;
+}
+
+
+// convert resized pixels to model input. float input is normalized
+// with the kernel of CPU variant
+static void normalize_input(float* out, const uint8_t* in, int count, Settings* s)
+{
+    if (s->input_floating) {
+        get_kernels()->normalize(in, out, count, s->input_mean, 1.0f / s->input_std);
+    } else {
+        for (int i = 0; i < count; i++) {
+            out[i] = in[i];
         }
     }
+    return;
+}
 
-    return squareImage;
+static void normalize_input(uint8_t* out, const uint8_t* in, int count, Settings* s)
+{
+    memcpy(out, in, count);
+    return;
 }
 
 
@@ -488,27 +551,36 @@ void resize(T* out, uint8_t* in, int image_width, int image_height,
                      resized, wanted_width, wanted_height, 0, wanted_channels);
 
   auto output_number_of_pixels = wanted_height * wanted_width * wanted_channels;
-
-  for (int i = 0; i < output_number_of_pixels; i++) {
-    if (s->input_floating)
-      out[i] = (resized[i] - s->input_mean) / s->input_std;
-    else
-      out[i] = (uint8_t)resized[i];
-  }
+  normalize_input(out, resized, output_number_of_pixels, s);
 
   free(resized);
   return;
 }
 
 
+bool parse_image_size(const std::string& str, int& width, int& height)
+{
+    // input size should be like "416" or "608x352"
+    size_t pos = str.find('x');
+    width = atoi(str.substr(0, pos).c_str());
+    height = (pos == std::string::npos) ? width : atoi(str.substr(pos + 1).c_str());
+
+    // YOLO feature map needs input size to be multiple of 32
+    return (width > 0 && height > 0 && width % 32 == 0 && height % 32 == 0);
+}
+
+
 void RunInference(Settings* s) {
   if (!s->model_name.c_str()) {
     LOG(ERROR) << "no model file name\n";
     exit(-1);
   }
 
-  // load model
+  // load model. delegate should be released after interpreter
   std::unique_ptr<tflite::FlatBufferModel> model;
+#ifdef USE_XNNPACK
+  std::unique_ptr<TfLiteDelegate, void (*)(TfLiteDelegate*)> xnnpack_delegate(nullptr, TfLiteXNNPackDelegateDelete);
+#endif
   std::unique_ptr<tflite::Interpreter> interpreter;
   model = tflite::FlatBufferModel::BuildFromFile(s->model_name.c_str());
   if (!model) {
@@ -534,6 +606,52 @@ void RunInference(Settings* s) {
     interpreter->SetNumThreads(s->number_of_threads);
   }
 
+  // resize model input to the specified input size, before
+  // tensor memory is planned
+  if (s->model_input_width > 0 && s->model_input_height > 0) {
+    int input = interpreter->inputs()[0];
+    TfLiteIntArray* dims = interpreter->tensor(input)->dims;
+    std::vector<int> input_shape = {dims->data[0], s->model_input_height, s->model_input_width, dims->data[3]};
+    if (interpreter->ResizeInputTensor(input, input_shape) != kTfLiteOk) {
+      LOG(FATAL) << "Failed to resize input tensor!";
+      exit(-1);
+    }
+  }
+
+  // apply XNNPACK delegate for the supported ops, with its own
+  // threadpool. fp16 weights of model are handled by the delegate,
+  // and allow_fp16 also forces fp16 inference on supporting CPU
+  std::string delegate_info = "builtin kernels";
+  if (s->accel) {
+#ifdef USE_XNNPACK
+    TfLiteXNNPackDelegateOptions xnnpack_options = TfLiteXNNPackDelegateOptionsDefault();
+    xnnpack_options.num_threads = (s->number_of_threads > 0) ? s->number_of_threads : 1;
+    if (s->allow_fp16) {
+      // force fp16 flag is only in newer TF-Lite releases
+#ifdef TFLITE_XNNPACK_DELEGATE_FLAG_FORCE_FP16
+      xnnpack_options.flags |= TFLITE_XNNPACK_DELEGATE_FLAG_FORCE_FP16;
+#else
+      LOG(ERROR) << "XNNPACK delegate of this TF-Lite version can't force fp16, allow_fp16 ignored\n";
+#endif
+    }
+    xnnpack_delegate.reset(TfLiteXNNPackDelegateCreate(&xnnpack_options));
+
+    struct timeval delegate_start, delegate_stop;
+    gettimeofday(&delegate_start, nullptr);
+    if (interpreter->ModifyGraphWithDelegate(xnnpack_delegate.get()) != kTfLiteOk) {
+      LOG(FATAL) << "Failed to apply XNNPACK delegate\n";
+      exit(-1);
+    }
+    gettimeofday(&delegate_stop, nullptr);
+    delegate_info = "xnnpack, threads " + std::to_string(xnnpack_options.num_threads);
+    LOG(INFO) << "XNNPACK delegate applied in " << (get_us(delegate_stop) - get_us(delegate_start)) / 1000 << " ms\n";
+#else
+    LOG(FATAL) << "Not built with XNNPACK delegate, rebuild with -DUSE_XNNPACK=ON\n";
+    exit(-1);
+#endif
+  }
+  delegate_info += s->allow_fp16 ? ", fp16 allowed" : ", fp32";
+
   if (interpreter->AllocateTensors() != kTfLiteOk) {
     LOG(FATAL) << "Failed to allocate tensors!";
   }
@@ -569,20 +687,6 @@ void RunInference(Settings* s) {
       exit(-1);
   }
 
-  // pad input image to letterboxed for input resize
-  uint8_t* letterboxImage = letterbox_image(input_image, image_width, image_height, image_channel);
-  int square_dim = std::max(image_width, image_height);
-
-  std::vector<uint8_t> in(letterboxImage, letterboxImage + square_dim * square_dim * image_channel * sizeof(uint8_t));
-
-  // free input image
-  stbi_image_free(input_image);
-  if(letterboxImage != input_image) {
-      free(letterboxImage);
-  }
-  input_image = nullptr;
-  letterboxImage = nullptr;
-
   // assuming one input only
   int input = interpreter->inputs()[0];
 
@@ -598,32 +702,77 @@ void RunInference(Settings* s) {
   int input_width = dims->data[2];
   int input_channels = dims->data[3];
 
+  // use minimal rectangular model input for the image shape
+  if (s->rect_input) {
+    get_rect_input_shape(image_width, image_height, input_width, input_height, input_width, input_height);
+    std::vector<int> input_shape = {input_batch, input_height, input_width, input_channels};
+    if (interpreter->ResizeInputTensor(input, input_shape) != kTfLiteOk ||
+        interpreter->AllocateTensors() != kTfLiteOk) {
+      LOG(FATAL) << "Failed to resize input tensor!";
+      exit(-1);
+    }
+    LOG(INFO) << "rectangular input size: width:" << input_width << ", height:" << input_height << "\n";
+  }
+
+  // pad input image to letterboxed for input resize
+  int letterbox_width, letterbox_height;
+  uint8_t* letterboxImage = letterbox_image(input_image, image_width, image_height, image_channel,
+                                            input_width, input_height, letterbox_width, letterbox_height);
+
+  std::vector<uint8_t> in(letterboxImage, letterboxImage + letterbox_width * letterbox_height * image_channel * sizeof(uint8_t));
+
+  // free input image
+  stbi_image_free(input_image);
+  if(letterboxImage != input_image) {
+      free(letterboxImage);
+  }
+  input_image = nullptr;
+  letterboxImage = nullptr;
+
   if (s->verbose) LOG(INFO) << "input tensor info: "
                             << "type " << interpreter->tensor(input)->type << ", "
                             << "batch " << input_batch << ", "
                             << "height " << input_height << ", "
                             << "width " << input_width << ", "
                             << "channels " << input_channels << "\n";
-  // assume the model input is square
-  assert(input_width == input_height);
-
-  // resize image to model input shape
-  switch (interpreter->tensor(input)->type) {
-    case kTfLiteFloat32:
-      s->input_floating = true;
-      resize<float>(interpreter->typed_tensor<float>(input), in.data(),
-                    square_dim, square_dim, image_channel, input_width,
-                    input_height, input_channels, s);
-      break;
-    case kTfLiteUInt8:
-      resize<uint8_t>(interpreter->typed_tensor<uint8_t>(input), in.data(),
-                      square_dim, square_dim, image_channel, input_width,
+
+  // resize image to model input shape, into input buffer
+  TfLiteType input_type = interpreter->tensor(input)->type;
+  s->input_floating = (input_type == kTfLiteFloat32);
+  auto preprocess = [&](uint8_t* input_data) {
+    switch (input_type) {
+      case kTfLiteFloat32:
+        resize<float>((float*)input_data, in.data(),
+                      letterbox_width, letterbox_height, image_channel, input_width,
                       input_height, input_channels, s);
-      break;
-    default:
-      LOG(FATAL) << "cannot handle input type "
-                 << interpreter->tensor(input)->type << " yet";
+        break;
+      case kTfLiteUInt8:
+        resize<uint8_t>(input_data, in.data(),
+                        letterbox_width, letterbox_height, image_channel, input_width,
+                        input_height, input_channels, s);
+        break;
+      default:
+        LOG(FATAL) << "cannot handle input type "
+                   << input_type << " yet";
+        exit(-1);
+    }
+  };
+
+  // with input buffers, preprocess stage owns rotating aligned buffers
+  // bound to the input tensor by custom allocation, instead of writing
+  // into the tensor of interpreter
+  InputBufferRing input_buffers;
+  if (s->input_buffers > 0) {
+    if (!input_buffers.init(interpreter.get(), input, s->input_buffers)) {
+      exit(-1);
+    }
+    preprocess(input_buffers.buffer(0));
+    if (!input_buffers.bind(0)) {
       exit(-1);
+    }
+    LOG(INFO) << "input bound to " << input_buffers.size() << " custom buffers of " << input_buffers.bytes() << " bytes\n";
+  } else {
+    preprocess((uint8_t*)interpreter->tensor(input)->data.raw);
   }
 
 
@@ -644,7 +793,44 @@ void RunInference(Settings* s) {
     }
   }
   gettimeofday(&stop_time, nullptr);
-  LOG(INFO) << "invoked average time:" << (get_us(stop_time) - get_us(start_time)) / (s->loop_count * 1000) << " ms \n";
+  LOG(INFO) << "invoked average time (" << delegate_info << "):" << (get_us(stop_time) - get_us(start_time)) / (s->loop_count * 1000) << " ms \n";
+
+  // frame loop benchmark with rotating input buffers: the next frame
+  // is preprocessed into a free buffer while the bound one is invoked,
+  // compared with sequential preprocess & invoke
+  if (input_buffers.size() > 1) {
+    int num_buffers = input_buffers.size();
+
+    gettimeofday(&start_time, nullptr);
+    for (int i = 0; i < s->loop_count; i++) {
+      preprocess(input_buffers.buffer(i % num_buffers));
+      if (!input_buffers.bind(i % num_buffers)) {
+        exit(-1);
+      }
+      if (interpreter->Invoke() != kTfLiteOk) {
+        LOG(FATAL) << "Failed to invoke tflite!\n";
+      }
+    }
+    gettimeofday(&stop_time, nullptr);
+    LOG(INFO) << "sequential frame average time:" << (get_us(stop_time) - get_us(start_time)) / (s->loop_count * 1000) << " ms \n";
+
+    int current = (s->loop_count - 1) % num_buffers;
+    gettimeofday(&start_time, nullptr);
+    for (int i = 0; i < s->loop_count; i++) {
+      int next = (current + 1) % num_buffers;
+      auto next_preprocess = std::async(std::launch::async, preprocess, input_buffers.buffer(next));
+      if (interpreter->Invoke() != kTfLiteOk) {
+        LOG(FATAL) << "Failed to invoke tflite!\n";
+      }
+      next_preprocess.wait();
+      if (!input_buffers.bind(next)) {
+        exit(-1);
+      }
+      current = next;
+    }
+    gettimeofday(&stop_time, nullptr);
+    LOG(INFO) << "pipelined frame average time:" << (get_us(stop_time) - get_us(start_time)) / (s->loop_count * 1000) << " ms \n";
+  }
 
 
   // Do yolo_postprocess to parse out valid predictions
@@ -671,7 +857,7 @@ void RunInference(Settings* s) {
                                 << "width " << output_width << ", "
                                 << "channels " << output_channels << "\n";
       TfLiteTensor* feature_map = interpreter->tensor(output);
-      std::vector<std::pair<float, float>> anchorset = get_anchorset(anchors, feature_map->dims->data[2], input_width);
+      std::vector<std::pair<float, float>> anchorset = get_anchorset(anchors, feature_map->dims->data[2], feature_map->dims->data[1], input_width, input_height);
 
       // Now we only support float32 type output tensor
       assert(feature_map->type == kTfLiteFloat32);
@@ -700,6 +886,15 @@ void RunInference(Settings* s) {
                 << " (" << int(prediction_nms.x + prediction_nms.width) << ", " << int(prediction_nms.y + prediction_nms.height) << ")\n";
   }
 
+  // Save structured detection result
+  std::unique_ptr<ResultWriter> result_writer;
+  FILE* result_file = nullptr;
+  if (!s->result_file_name.empty() &&
+      open_result_writer(s->result_file_name, s->result_format, classes, result_writer, result_file)) {
+    result_writer->write(s->input_img_name, 0, image_width, image_height, prediction_nms_list);
+    close_result_writer(result_writer, result_file);
+  }
+
   return;
 }
 
@@ -713,9 +908,16 @@ void display_usage() {
       << "--input_mean, -b: input mean\n"
       << "--input_std, -s: input standard deviation\n"
       << "--allow_fp16, -f: [0|1], allow running fp32 models with fp16 or not\n"
+      << "--accel, -x: [0|1] use XNNPACK delegate with threadpool of --threads\n"
+      << "--input_buffers, -B: number of rotating input buffers bound with custom allocation, 2+ to benchmark preprocess pipelined with invoke. default 0 (use input tensor)\n"
       << "--threads, -t: number of threads\n"
       << "--count, -c: loop interpreter->Invoke() for certain times\n"
       << "--warmup_runs, -w: number of warmup runs\n"
+      << "--result_file, -o: output file for detection result\n"
+      << "--result_format, -g: [text|json|binary] format of detection result file, default text\n"
+      << "--model_image_size, -q: model input size like 416 or 608x352, default the model input shape\n"
+      << "--rect_input, -R: [0|1] use minimal rectangular input of stride 32 multiple for image shape, within model_image_size\n"
+      << "--cpu_kernel, -X: [auto|generic|sse4.1|avx2|avx512|neon] force CPU variant of pre/postprocess kernels for benchmark, default auto\n"
       << "--verbose, -v: [0|1] print more information\n"
       << "\n";
 }
@@ -734,8 +936,15 @@ int Main(int argc, char** argv) {
         {"input_std", required_argument, nullptr, 's'},
         {"threads", required_argument, nullptr, 't'},
         {"allow_fp16", required_argument, nullptr, 'f'},
+        {"accel", required_argument, nullptr, 'x'},
+        {"input_buffers", required_argument, nullptr, 'B'},
         {"count", required_argument, nullptr, 'c'},
         {"warmup_runs", required_argument, nullptr, 'w'},
+        {"result_file", required_argument, nullptr, 'o'},
+        {"result_format", required_argument, nullptr, 'g'},
+        {"model_image_size", required_argument, nullptr, 'q'},
+        {"rect_input", required_argument, nullptr, 'R'},
+        {"cpu_kernel", required_argument, nullptr, 'X'},
         {"verbose", required_argument, nullptr, 'v'},
         {"help", no_argument, nullptr, 'h'},
         {nullptr, 0, nullptr, 0}};
@@ -744,7 +953,7 @@ int Main(int argc, char** argv) {
     int option_index = 0;
 
     c = getopt_long(argc, argv,
-                    "a:b:c:f:hi:l:m:s:t:v:w:", long_options,
+                    "a:b:B:c:f:g:hi:l:m:o:q:R:s:t:v:w:x:X:", long_options,
                     &option_index);
 
     /* Detect the end of the options. */
@@ -757,6 +966,10 @@ int Main(int argc, char** argv) {
       case 'b':
         s.input_mean = strtod(optarg, nullptr);
         break;
+      case 'B':
+        s.input_buffers =
+            strtol(optarg, nullptr, 10);  // NOLINT(runtime/deprecated_fn)
+        break;
       case 'c':
         s.loop_count =
             strtol(optarg, nullptr, 10);  // NOLINT(runtime/deprecated_fn)
@@ -765,6 +978,9 @@ int Main(int argc, char** argv) {
         s.allow_fp16 =
             strtol(optarg, nullptr, 10);  // NOLINT(runtime/deprecated_fn)
         break;
+      case 'g':
+        s.result_format = optarg;
+        break;
       case 'i':
         s.input_img_name = optarg;
         break;
@@ -774,6 +990,19 @@ int Main(int argc, char** argv) {
       case 'm':
         s.model_name = optarg;
         break;
+      case 'o':
+        s.result_file_name = optarg;
+        break;
+      case 'q':
+        if (!parse_image_size(optarg, s.model_input_width, s.model_input_height)) {
+          LOG(ERROR) << "Invalid model image size " << optarg << ", should be multiple of 32\n";
+          exit(-1);
+        }
+        break;
+      case 'R':
+        s.rect_input =
+            strtol(optarg, nullptr, 10);  // NOLINT(runtime/deprecated_fn)
+        break;
       case 's':
         s.input_std = strtod(optarg, nullptr);
         break;
@@ -789,6 +1018,16 @@ int Main(int argc, char** argv) {
         s.number_of_warmup_runs =
             strtol(optarg, nullptr, 10);  // NOLINT(runtime/deprecated_fn)
         break;
+      case 'x':
+        s.accel =
+            strtol(optarg, nullptr, 10);  // NOLINT(runtime/deprecated_fn)
+        break;
+      case 'X':
+        if (!set_kernel_variant(optarg)) {
+          LOG(ERROR) << "CPU kernel variant " << optarg << " is not supported\n";
+          exit(-1);
+        }
+        break;
       case 'h':
       case '?':
       default:
@@ -798,6 +1037,7 @@ int Main(int argc, char** argv) {
         exit(-1);
     }
   }
+  LOG(INFO) << "cpu kernel: " << get_kernels()->name << "\n";
   RunInference(&s);
   return 0;
 }
@@ -11,12 +11,13 @@
 
 #include "tensorflow/lite/model.h"
 #include "tensorflow/lite/string_type.h"
+#include "yoloPrediction.h"
 
 namespace yoloDetection {
 
 struct Settings {
   bool verbose = false;
-  bool accel = false;
+  bool accel = false;            // apply XNNPACK delegate
   bool input_floating = false;
   bool allow_fp16 = false;
   int loop_count = 1;
@@ -27,9 +28,15 @@ struct Settings {
   std::string input_img_name = "./dog.jpg";
   std::string classes_file_name = "./classes.txt";
   std::string anchors_file_name = "./yolo3_anchors.txt";
+  std::string result_file_name = "";
+  std::string result_format = "text";
+  int model_input_width = 0;   // 0 for the model default input shape
+  int model_input_height = 0;
+  bool rect_input = false;
   std::string input_layer_type = "uint8_t";
   int number_of_threads = 4;
   int number_of_warmup_runs = 2;
+  int input_buffers = 0;          // rotating input buffers with custom allocation
 };
 
 }  // namespace yoloDetection